@@ -21,8 +21,10 @@
 #include <QtCore/QStringList>
 #include <QtCore/QFile>
 #include <QtCore/QTextStream>
+#include <QtCore/QElapsedTimer>
 
 #include <QFileInfo>
+#include <QDir>
 
 #include "LeanDocLexer2.h"
 #include "LeanDocParser2.h"
@@ -30,22 +32,21 @@
 #include "LeanDocTypstGen.h"
 #include "LeanDocAst2.h"
 #include "LeanDocValidator.h"
+#include "LeanDocNormalizer.h"
+#include "LeanDocIndex.h"
+#include "LeanDocMath.h"
+#include "LeanDocAssets.h"
+#include "LeanDocSnapshot.h"
+#include "LeanDocIr.h"
+#include "LeanDocDiagnostics.h"
+#include "LeanDocUtf8.h"
+#include "LeanDocFileIo.h"
+#include "LeanDocScheduler.h"
+#include "LeanDocJobServer.h"
+#include "LeanDocPipeline.h"
 
 using namespace LeanDoc;
 
-static bool readFileUtf8(const QString& path, QString* outText, QString* outErr)
-{
-    QFile f(path);
-    if (!f.open(QIODevice::ReadOnly)) {
-        if (outErr)
-            *outErr = "Cannot open file: " + path;
-        return false;
-    }
-    QByteArray bytes = f.readAll();
-    *outText = QString::fromUtf8(bytes.constData(), bytes.size());
-    return true;
-}
-
 static bool writeFileUtf8(const QString& path, const QString& text, QString* outErr)
 {
     QFile f(path);
@@ -58,117 +59,758 @@ static bool writeFileUtf8(const QString& path, const QString& text, QString* out
     return true;
 }
 
-int main(int argc, char** argv)
+static QString indexDataPath(const QString& outPath)
 {
-    QCoreApplication app(argc, argv);
-    QTextStream out(stdout);
-    QTextStream err(stderr);
-
-    const QStringList args = app.arguments();
-    if (args.size() < 2) {
-        err << "Usage:\n"
-            << "  leandoc --typst <in.adoc> -o <out.typ> [--template plain|report] [--template-file tpl.typ]\n"
-            << "  leandoc --ast <in.adoc>\n"
-            << "  leandoc <in.adoc>\n";
-        return 2;
-    }
+    const QFileInfo info(outPath);
+    return info.path() + "/" + info.completeBaseName() + ".index.tsv";
+}
 
-    bool modeAst = false, modeTypst = false;
-    QString inPath, outPath = "output.typ";
+struct RunOptions {
+    bool modeAst, modeTypst, modeIr, stats, normalize, stream, indexData;
+    int errorLimit;
+    Parser::Options parseOpt;
     TypstGenerator::Options genOpt;
+    MathCache* math; // shared by all documents
+    AssetStore* assets; // 0: the images are referenced where they are
+    RunOptions():modeAst(false),modeTypst(false),modeIr(false),stats(false),normalize(false),stream(false),indexData(false),errorLimit(0),math(0),assets(0){}
+};
 
-    for (int i=1;i<args.size();++i) {
-        const QString a = args[i];
-        if (a == "--ast") {
-            modeAst = true;
-            modeTypst = false;
-        } else if (a == "--typst") {
-            modeAst = false;
-            modeTypst = true;
-        } else if (a == "-o" && i+1 < args.size())
-            outPath = args[++i];
-        else if (a == "--template" && i+1 < args.size())
-            genOpt.templateName = args[++i];
-        else if (a == "--template-file" && i+1 < args.size())
-            genOpt.templateFile = args[++i];
-        else if (a == "--no-raw")
-            genOpt.allowRawPassthrough = false;
-        else if (!a.startsWith("-") && inPath.isEmpty())
-            inPath = a;
+// the images of the document in the asset directory, as seen from the output file
+static void mapAssets(const AssetStore* assets, const QStringList& images, const QString& outPath,
+                      QHash<QString,QString>& paths)
+{
+    const QDir outDir = QFileInfo(outPath).absoluteDir();
+    for (int i = 0; i < images.size(); ++i) {
+        const QString name = assets->nameOf(images[i]);
+        if (!name.isEmpty())
+            paths.insert(images[i], outDir.relativeFilePath(assets->dir() + "/" + name));
     }
+}
 
-    if (inPath.isEmpty()) {
-        err << "Error: provide an input file.\n";
-        return 2;
+static int writeTypst(const Node* doc, const QString& outPath, const RunOptions& ro, Index* index,
+                      const TitleIndex* titles, DiagnosticSink& sink, QTextStream& out, QTextStream& err)
+{
+    TypstGenerator gen(ro.genOpt);
+    gen.setIndex(index);
+    gen.setTitles(titles);
+    gen.setMathCache(ro.math);
+    TypstGenError ge;
+    QString typ;
+    QTextStream typOut(&typ);
+
+    if (!gen.generate(doc, typOut, &ge)) {
+        sink.report(Diagnostic::Error, Diagnostic::Generate, ge.line, 0, ge.message);
+        sink.finish();
+        return 1;
     }
+    sink.finish();
 
-    QString text, ioErr;
-    if (!readFileUtf8(inPath, &text, &ioErr)) {
+    QString ioErr;
+    if (!writeFileUtf8(outPath, typ, &ioErr)) {
         err << ioErr << "\n";
         return 2;
     }
 
-    Parser parser;
-    Node* doc = parser.parse(text);
+    out << "Wrote " << outPath << "\n";
+    return 0;
+}
+
+static int renderIr(const QString& inPath, const QByteArray& bytes, const QString& outPath,
+                    const RunOptions& ro, bool withFile, QTextStream& out, QTextStream& err)
+{
+    // the document was checked when the IR was written, so only the tree is rebuilt and
+    // rendered; decoding, parsing, preprocessing and validation are skipped
+    const QString prefix = withFile ? inPath + ": " : QString();
+    if (!ro.modeTypst && !ro.modeAst) {
+        err << prefix << "IR input requires --typst or --ast\n";
+        return 2;
+    }
+    Ir ir;
+    QString irErr;
+    Node* doc = ir.load(bytes, &irErr) ? ir.toTree() : 0;
     if (!doc) {
-        err << "Parse failed (null result)\n";
+        err << prefix << (irErr.isEmpty() ? QString("inconsistent LeanDoc IR") : irErr) << "\n";
         return 1;
     }
+    Index index;
+    index.collect(doc);
+    TitleIndex titles;
+    titles.collect(doc);
+    titles.finish();
+    const Snapshot snap(doc);
+    if (ro.modeAst) {
+        doc->dump(out);
+        return 0;
+    }
+    DiagnosticSink sink(inPath);
+    sink.setStream(&err, withFile);
+    sink.expectPhase(Diagnostic::Generate);
+    return writeTypst(doc, outPath, ro, &index, &titles, sink, out, err);
+}
+
+// One document on its way through the phases. Each phase returns false if the remaining
+// ones have nothing to do; write() then returns the result code.
+class Conversion {
+public:
+    Conversion(const QString& inPath, const QByteArray& bytes, const QString& outPath,
+               const RunOptions& ro, bool withFile, QTextStream& out, QTextStream& err);
+    ~Conversion() { delete dsnap; }
+
+    bool parse();
+    bool preprocess();
+    bool validate();
+    bool generate();
+    int write();
+
+private:
+    QString prefix() const { return dwithFile ? dinPath + ": " : QString(); }
+    bool stop(int rc) { drc = rc; ddone = true; return false; }
+
+    const QString dinPath;
+    const QString doutPath;
+    QByteArray dbytes; // released after decoding
+    const RunOptions& dro;
+    const bool dwithFile;
+    QTextStream& dout;
+    QTextStream& derr;
+    DiagnosticSink dsink;
+    Node* ddoc;
+    Snapshot* dsnap;
+    Index dindex;
+    TitleIndex dtitles;
+    QHash<QString,QString> dimages; // see mapAssets()
+    QByteArray dresult; // the file to write
+    int drc;
+    bool ddone;
+};
+
+Conversion::Conversion(const QString& inPath, const QByteArray& bytes, const QString& outPath,
+                       const RunOptions& ro, bool withFile, QTextStream& out, QTextStream& err):
+    dinPath(inPath),doutPath(outPath),dbytes(bytes),dro(ro),dwithFile(withFile),dout(out),derr(err),
+    dsink(inPath),ddoc(0),dsnap(0),drc(0),ddone(false)
+{
+    // all phases report to the sink, which writes the diagnostics in document order; the
+    // generator is only expected if it runs, otherwise it would hold back all of them
+    dsink.setErrorLimit(ro.errorLimit);
+    dsink.setStream(&err, withFile);
+    for (int p = Diagnostic::Decode; p < Diagnostic::Generate; ++p)
+        dsink.expectPhase(Diagnostic::Phase(p));
+}
+
+bool Conversion::parse()
+{
+    if (ddone)
+        return false;
+    Utf8Decoder dec;
+    const QString text = dec.decode(dbytes);
+    dbytes = QByteArray();
+    for (int i = 0; i < dec.errors.size(); ++i)
+        dsink.report(Diagnostic::Error, Diagnostic::Decode, dec.errors[i].pos.row, dec.errors[i].pos.col,
+                     dec.errors[i].message);
+    dsink.endPhase(Diagnostic::Decode);
+
+    Parser parser(dro.parseOpt);
+    ddoc = parser.parse(text);
+    if (!ddoc) {
+        dsink.finish();
+        derr << prefix() << "Parse failed (null result)\n";
+        return stop(1);
+    }
+
+    if (dro.stats) {
+        const Parser::InlineMemo& memo = parser.inlineMemo();
+        const StringPool& pool = static_cast<Document*>(ddoc)->strings;
+        derr << prefix() << "inline cache: " << memo.hits << " of "
+             << memo.lookups << " lookups hit ("
+             << (memo.lookups ? memo.hits * 100 / memo.lookups : 0) << "%), string pool: "
+             << pool.count() << " strings for " << pool.lookups() << " lookups\n";
+        int nodes = 0, chars = 0;
+        TreeIterator it(ddoc, TreeIterator::WithTitles);
+        while (const Node* n = it.next()) {
+            nodes++;
+            chars += n->text.size() + n->name.size() + n->target.size();
+        }
+        derr << prefix() << "tree: " << nodes << " nodes, " << chars << " characters\n";
+    }
 
     for (int i = 0; i < parser.errors.size(); ++i)
-        err << "Error at line " << parser.errors[i].pos.row << ": " << parser.errors[i].message << "\n";
+        dsink.report(Diagnostic::Error, Diagnostic::Parse, parser.errors[i].pos.row, 0, parser.errors[i].message);
+    dsink.endPhase(Diagnostic::Parse);
+    return true;
+}
 
+bool Conversion::preprocess()
+{
+    if (ddone)
+        return false;
+    const bool collect = dro.assets && dro.modeTypst;
     Preprocessor preproc;
-    preproc.setBaseDir(QFileInfo(inPath).absolutePath());
-    preproc.process(doc);
+    preproc.setParserOptions(dro.parseOpt);
+    preproc.setBaseDir(QFileInfo(dinPath).absolutePath());
+    preproc.setCollectFiles(collect);
+    preproc.process(ddoc);
     for (int i = 0; i < preproc.errors.size(); ++i)
-        err << "Error at line " << preproc.errors[i].line << ": " << preproc.errors[i].message << "\n";
+        dsink.report(Diagnostic::Error, Diagnostic::Preprocess, preproc.errors[i].line, 0, preproc.errors[i].message);
+    if (collect) {
+        QString ioErr;
+        if (!dro.assets->add(preproc.imageFiles, preproc.includedFiles, &ioErr))
+            dsink.report(Diagnostic::Error, Diagnostic::Preprocess, 0, 0, ioErr);
+        mapAssets(dro.assets, preproc.imageFiles, doutPath, dimages);
+    }
+    dsink.endPhase(Diagnostic::Preprocess);
 
-    // validation pass
-    Validator validator;
-    validator.validate(doc);
-    for (int i = 0; i < validator.diagnostics.size(); ++i) {
-        const Diagnostic& d = validator.diagnostics[i];
-        err << (d.level == Diagnostic::Error ? "Error" : "Warning")
-            << " at line " << d.line << ": " << d.message << "\n";
+    if (dro.normalize) {
+        Normalizer norm;
+        norm.normalize(ddoc);
+        if (dro.stats)
+            derr << prefix() << "normalize: " << norm.nodesBefore()
+                 << " nodes before, " << norm.nodesAfter() << " after\n";
     }
 
-    const bool hasErrors = !(parser.errors.isEmpty() && validator.diagnostics.isEmpty() && preproc.errors.isEmpty());
+    if (dro.modeTypst)
+        dindex.collect(ddoc); // labels the index terms
+    dtitles.collect(ddoc);
+    dtitles.finish();
 
-    if (modeAst) {
-        doc->dump(out);
-        Node::deleteTree(doc);
-        return hasErrors ? 1 : 0;
+    // from here on the tree is immutable; the snapshot releases it
+    dsnap = new Snapshot(ddoc);
+    return true;
+}
+
+bool Conversion::validate()
+{
+    if (ddone)
+        return false;
+    if (!dsink.aborted()) {
+        Validator validator;
+        validator.setSink(&dsink);
+        validator.setTitles(&dtitles);
+        validator.validate(ddoc);
+    }
+    dsink.endPhase(Diagnostic::Validate);
+
+    if (dsink.aborted()) {
+        dsink.finish();
+        derr << prefix() << "Too many errors (" << dsink.errorCount() << "), stopping\n";
+        return stop(1);
     }
+    return true;
+}
 
+bool Conversion::generate()
+{
+    if (ddone)
+        return false;
+    const bool hasErrors = dsink.count() != 0;
+
+    if (dro.modeAst) {
+        dsink.finish();
+        ddoc->dump(dout);
+        return stop(hasErrors ? 1 : 0);
+    }
 
-    if (modeTypst && !hasErrors) {
-        TypstGenerator gen(genOpt);
+    if (dro.modeTypst && !hasErrors) {
+        TypstGenerator gen(dro.genOpt);
+        gen.setIndex(&dindex);
+        gen.setTitles(&dtitles);
+        gen.setMathCache(dro.math);
+        gen.setImagePaths(&dimages);
+        dsink.expectPhase(Diagnostic::Generate);
         TypstGenError ge;
         QString typ;
         QTextStream typOut(&typ);
+        if (!gen.generate(ddoc, typOut, &ge)) {
+            dsink.report(Diagnostic::Error, Diagnostic::Generate, ge.line, 0, ge.message);
+            dsink.finish();
+            return stop(1);
+        }
+        dsink.finish();
+        typOut.flush();
+        dresult = typ.toUtf8();
+    } else if (dro.modeIr && !hasErrors) {
+        dsink.finish();
+        dresult = Ir::fromTree(ddoc).save();
+    } else {
+        dsink.finish();
+        if (!hasErrors)
+            dout << prefix() << "File successfully checked\n";
+        return stop(hasErrors ? 1 : 0);
+    }
 
-        if (!gen.generate(doc, typOut, &ge)) {
-            err << "Typst generation error at line " << ge.line << ": " << ge.message << "\n";
-            Node::deleteTree(doc);
-            return 1;
+    // only the output is needed from here on
+    delete dsnap;
+    dsnap = 0;
+    return true;
+}
+
+int Conversion::write()
+{
+    if (ddone)
+        return drc;
+    QFile f(doutPath);
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        derr << "Cannot write file: " << doutPath << "\n";
+        return 2;
+    }
+    f.write(dresult);
+    dout << "Wrote " << doutPath << "\n";
+    if (dro.indexData && dro.modeTypst) {
+        const QString path = indexDataPath(doutPath);
+        QString ioErr;
+        if (!writeFileUtf8(path, dindex.toTsv(), &ioErr)) {
+            derr << ioErr << "\n";
+            return 2;
         }
+        dout << "Wrote " << path << "\n";
+    }
+    return 0;
+}
+
+static int convert(const QString& inPath, const QByteArray& bytes, const QString& outPath,
+                   const RunOptions& ro, bool withFile, QTextStream& out, QTextStream& err)
+{
+    Conversion c(inPath, bytes, outPath, ro, withFile, out, err);
+    if (c.parse() && c.preprocess() && c.validate())
+        c.generate();
+    return c.write();
+}
+
+static int streamConvert(const QString& inPath, const QByteArray& bytes, const QString& outPath,
+                         const RunOptions& ro, bool withFile, QTextStream& out, QTextStream& err)
+{
+    // like convert(), but each top-level block is preprocessed, checked, rendered and freed
+    // before the next one is parsed, so the memory is bounded by the largest block (plus the
+    // source text). The diagnostics are written in document order as soon as the blocks
+    // before them are done; the generator only runs while there are none, so it does not
+    // have to be waited for.
+    const QString prefix = withFile ? inPath + ": " : QString();
+    DiagnosticSink sink(inPath);
+    sink.setErrorLimit(ro.errorLimit);
+    sink.setStream(&err, withFile);
+    for (int p = Diagnostic::Decode; p < Diagnostic::Generate; ++p)
+        sink.expectPhase(Diagnostic::Phase(p));
+
+    Utf8Decoder dec;
+    const QString text = dec.decode(bytes);
+    for (int i = 0; i < dec.errors.size(); ++i)
+        sink.report(Diagnostic::Error, Diagnostic::Decode, dec.errors[i].pos.row, dec.errors[i].pos.col,
+                    dec.errors[i].message);
+    sink.endPhase(Diagnostic::Decode);
 
+    Parser parser(ro.parseOpt);
+    Node* doc = parser.parseHeader(text);
+    int parseErrors = 0;
+
+    const bool collect = ro.assets && ro.modeTypst;
+    Preprocessor preproc;
+    preproc.setParserOptions(ro.parseOpt);
+    preproc.setBaseDir(QFileInfo(inPath).absolutePath());
+    preproc.setCollectFiles(collect);
+    preproc.begin(doc);
+    QHash<QString,QString> images; // see mapAssets()
+
+    // a cross-reference may precede its section, which is then already written; therefore
+    // all sections get their label
+    TitleIndex titles; // of the blocks so far
+    titles.setLabelAll(true);
+
+    Validator validator;
+    validator.setSink(&sink);
+    validator.setTitles(&titles);
+    validator.begin(doc);
+
+    // the output is only kept if the document has no diagnostics, like in convert()
+    QFile f(outPath);
+    if (ro.modeTypst && !f.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
         Node::deleteTree(doc);
+        sink.finish();
+        err << "Cannot write file: " << outPath << "\n";
+        return 2;
+    }
+    Index index; // of the blocks so far
+    TypstGenerator gen(ro.genOpt);
+    gen.setIndex(&index);
+    gen.setTitles(&titles);
+    gen.setMathCache(ro.math);
+    gen.setImagePaths(&images);
+    TypstGenError ge;
+    bool emitting = ro.modeTypst;
+    QString typ;
+    QTextStream typOut(&typ);
+    if (emitting && !gen.generateHeader(doc, typOut, &ge)) {
+        sink.report(Diagnostic::Error, Diagnostic::Generate, ge.line, 0, ge.message);
+        emitting = false;
+    }
 
-        if (!writeFileUtf8(outPath, typ, &ioErr)) {
-            err << ioErr << "\n";
-            return 2;
+    // the comments before the header are already in the document
+    QList<Node*> parts = doc->children;
+    doc->children.clear();
+    int maxNodes = 0, nodesBefore = 0, nodesAfter = 0;
+    while (!sink.aborted()) {
+        Node* b = parts.isEmpty() ? parser.parseNextBlock() : parts.takeFirst();
+        for (; parseErrors < parser.errors.size(); ++parseErrors)
+            sink.report(Diagnostic::Error, Diagnostic::Parse, parser.errors[parseErrors].pos.row, 0,
+                        parser.errors[parseErrors].message);
+        if (!b)
+            break;
+        const int line = b->metaRow > 0 && b->metaRow < int(b->pos.row) ? b->metaRow : int(b->pos.row);
+        sink.setProgress(Diagnostic::Parse, line);
+        sink.setProgress(Diagnostic::Preprocess, line);
+
+        // includes and conditionals may turn the block into several or none
+        doc->add(b);
+        preproc.processBlocks(doc);
+        for (int i = 0; i < preproc.errors.size(); ++i)
+            sink.report(Diagnostic::Error, Diagnostic::Preprocess, preproc.errors[i].line, 0,
+                        preproc.errors[i].message);
+        preproc.errors.clear();
+        if (collect) {
+            QString ioErr;
+            if (!ro.assets->add(preproc.imageFiles, preproc.includedFiles, &ioErr))
+                sink.report(Diagnostic::Error, Diagnostic::Preprocess, 0, 0, ioErr);
+            mapAssets(ro.assets, preproc.imageFiles, outPath, images);
+            preproc.imageFiles.clear();
+            preproc.includedFiles.clear();
+        }
+
+        for (int i = 0; i < doc->children.size(); ++i) {
+            Node* n = doc->children[i];
+            if (ro.normalize) {
+                Normalizer norm;
+                norm.normalize(n);
+                nodesBefore += norm.nodesBefore();
+                nodesAfter += norm.nodesAfter();
+            }
+            if (ro.stats) {
+                int count = 0;
+                TreeIterator it(n, TreeIterator::WithTitles);
+                while (it.next())
+                    count++;
+                if (count > maxNodes)
+                    maxNodes = count;
+            }
+            if (ro.modeTypst)
+                index.collect(n);
+            titles.collect(n);
+            titles.finish();
+            validator.validateBlock(n);
+            if (emitting && sink.count() == 0 && !gen.generateBlock(doc, n, typOut, &ge)) {
+                sink.report(Diagnostic::Error, Diagnostic::Generate, ge.line, 0, ge.message);
+                emitting = false;
+            }
+            if (emitting && sink.count() == 0) {
+                typOut.flush();
+                f.write(typ.toUtf8());
+                typ.clear();
+            }
+            Node::deleteTree(n);
         }
+        doc->children.clear();
+    }
+    for (int i = 0; i < parts.size(); ++i)
+        Node::deleteTree(parts[i]);
+    sink.endPhase(Diagnostic::Parse);
+    sink.endPhase(Diagnostic::Preprocess);
+    if (!sink.aborted())
+        validator.end();
+    sink.endPhase(Diagnostic::Validate);
 
+    if (ro.stats) {
+        err << prefix << "stream: largest top-level block " << maxNodes << " nodes\n";
+        if (ro.normalize)
+            err << prefix << "normalize: " << nodesBefore << " nodes before, " << nodesAfter << " after\n";
+    }
+    Node::deleteTree(doc);
+    sink.finish();
+
+    if (sink.aborted()) {
+        f.remove();
+        err << prefix << "Too many errors (" << sink.errorCount() << "), stopping\n";
+        return 1;
+    }
+    const bool hasErrors = sink.count() != 0;
+    if (ro.modeTypst) {
+        if (hasErrors || !emitting) {
+            f.remove();
+            return 1;
+        }
+        f.close();
         out << "Wrote " << outPath << "\n";
+        if (ro.indexData) {
+            QString ioErr;
+            if (!writeFileUtf8(indexDataPath(outPath), index.toTsv(), &ioErr)) {
+                err << ioErr << "\n";
+                return 2;
+            }
+            out << "Wrote " << indexDataPath(outPath) << "\n";
+        }
         return 0;
     }
+    if (!hasErrors)
+        out << prefix << "File successfully checked\n";
+    return hasErrors ? 1 : 0;
+}
 
-    Node::deleteTree(doc);
+// A document in the multi-input pipeline; its output is collected and written by the last
+// stage, so the output of different documents is not interleaved.
+class ConversionJob : public PipelineJob {
+public:
+    enum Stage { Read, Parse, Preprocess, Validate, Generate, Write };
+    ConversionJob(const FileBatchReader::Result& r, const QString& outPath, const RunOptions& ro,
+                  QTextStream& out, QTextStream& err, int* res):
+        dpath(r.path),dreadError(r.error),dro(ro),dout(out),derr(err),dres(res),
+        dbufOut(&dtextOut),dbufErr(&dtextErr),dconv(0),drc(0)
+    {
+        if (dreadError.isEmpty() && !dpath.endsWith(".ldir") && !ro.stream)
+            dconv = new Conversion(dpath, r.data, outPath, ro, true, dbufOut, dbufErr);
+        else
+            ddata = r.data;
+        doutPath = outPath;
+    }
+    ~ConversionJob() { delete dconv; }
+    void run(int stage)
+    {
+        switch (stage) {
+        case Parse:
+            if (dconv)
+                dconv->parse();
+            break;
+        case Preprocess:
+            if (dconv)
+                dconv->preprocess();
+            break;
+        case Validate:
+            if (dconv)
+                dconv->validate();
+            break;
+        case Generate:
+            if (dconv)
+                dconv->generate();
+            else if (dreadError.isEmpty()) {
+                // not split into stages
+                drc = dpath.endsWith(".ldir") ? renderIr(dpath, ddata, doutPath, dro, true, dbufOut, dbufErr)
+                                              : streamConvert(dpath, ddata, doutPath, dro, true, dbufOut, dbufErr);
+                ddata = QByteArray();
+            }
+            break;
+        case Write:
+            if (!dreadError.isEmpty()) {
+                dbufErr << dreadError << "\n";
+                drc = 2;
+            } else if (dconv) {
+                drc = dconv->write();
+                delete dconv;
+                dconv = 0;
+            }
+            dbufOut.flush();
+            dbufErr.flush();
+            dout << dtextOut;
+            derr << dtextErr;
+            dout.flush();
+            derr.flush();
+            if (drc > *dres)
+                *dres = drc;
+            break;
+        }
+    }
+private:
+    QString dpath;
+    QString doutPath;
+    QString dreadError;
+    QByteArray ddata;
+    const RunOptions& dro;
+    QTextStream& dout;
+    QTextStream& derr;
+    int* dres;
+    QString dtextOut;
+    QString dtextErr;
+    QTextStream dbufOut;
+    QTextStream dbufErr;
+    Conversion* dconv;
+    int drc;
+};
 
-    if( !hasErrors )
-        out << "File successfully checked\n";
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+    QTextStream out(stdout);
+    QTextStream err(stderr);
 
-    return hasErrors ? 1 : 0;
+    const QStringList args = app.arguments();
+    if (args.size() < 2) {
+        err << "Usage:\n"
+            << "  leandoc --typst <in.adoc> -o <out.typ> [--template plain|report] [--template-file tpl.typ]\n"
+            << "  leandoc --typst <in1.adoc> <in2.adoc>... [-o <outdir>]\n"
+            << "  leandoc --ast <in.adoc>\n"
+            << "  leandoc --ir <in.adoc> -o <out.ldir>  (save the checked document; --typst/--ast accept .ldir inputs)\n"
+            << "  leandoc <in.adoc>...\n"
+            << "Options:\n"
+            << "  --threads N     worker threads incl. the main thread (0 = one per core, 1 = serial);\n"
+            << "                  under make -jN the threads share the jobserver tokens with the other jobs\n"
+            << "  --max-errors N  stop a document after N errors (0 = no limit)\n"
+            << "  --lean          drop the comments, also the // lines they give in the .typ, and the\n"
+            << "                  raw section titles, which only --ast shows\n"
+            << "  --stream        check and render one top-level block at a time, which bounds the\n"
+            << "                  memory by the largest section (not with --ast or --ir)\n"
+            << "  --index-data    also write the sorted index terms to <out>.index.tsv\n"
+            << "  --math-cache F  keep the latexmath translations in file F for the next run\n"
+            << "  --assets DIR    copy the images into DIR, named by the hash of their content, and\n"
+            << "                  list them and the included files in DIR/manifest.tsv (with --typst)\n"
+            << "  --normalize     merge adjacent text and drop empty or redundant inline nodes\n"
+            << "  --stats         print parser cache statistics, with several inputs also the time\n"
+            << "                  each phase of the pipeline was busy, starved or blocked\n";
+        return 2;
+    }
+
+    RunOptions ro;
+    QStringList inPaths;
+    QString outPath, mathCachePath, assetDir;
+    bool threadsGiven = false;
+
+    for (int i=1;i<args.size();++i) {
+        const QString a = args[i];
+        if (a == "--ast") {
+            ro.modeAst = true;
+            ro.modeTypst = ro.modeIr = false;
+        } else if (a == "--typst") {
+            ro.modeTypst = true;
+            ro.modeAst = ro.modeIr = false;
+        } else if (a == "--ir") {
+            ro.modeIr = true;
+            ro.modeAst = ro.modeTypst = false;
+        } else if (a == "-o" && i+1 < args.size())
+            outPath = args[++i];
+        else if (a == "--template" && i+1 < args.size())
+            ro.genOpt.templateName = args[++i];
+        else if (a == "--template-file" && i+1 < args.size())
+            ro.genOpt.templateFile = args[++i];
+        else if (a == "--no-raw")
+            ro.genOpt.allowRawPassthrough = false;
+        else if (a == "--stats")
+            ro.stats = true;
+        else if (a == "--lean") {
+            ro.parseOpt.keepComments = false;
+            ro.parseOpt.keepRawTitles = false;
+        } else if (a == "--stream")
+            ro.stream = true;
+        else if (a == "--index-data")
+            ro.indexData = true;
+        else if (a == "--normalize")
+            ro.normalize = true;
+        else if (a == "--math-cache" && i+1 < args.size())
+            mathCachePath = args[++i];
+        else if (a == "--assets" && i+1 < args.size())
+            assetDir = args[++i];
+        else if (a == "--max-errors" && i+1 < args.size())
+            ro.errorLimit = args[++i].toInt();
+        else if (a == "--threads" && i+1 < args.size()) {
+            Scheduler::setDefaultThreadCount(args[++i].toInt());
+            threadsGiven = true;
+        }
+        else if (!a.startsWith("-"))
+            inPaths << a;
+    }
+
+    if (inPaths.isEmpty()) {
+        err << "Error: provide an input file.\n";
+        return 2;
+    }
+    if (ro.stream && (ro.modeAst || ro.modeIr)) {
+        err << "Error: --stream cannot be combined with --ast or --ir.\n";
+        return 2;
+    }
+
+    MathCache math;
+    ro.math = &math;
+    QString mathErr;
+    if (!mathCachePath.isEmpty() && !math.load(mathCachePath, &mathErr)) {
+        err << mathErr << "\n";
+        return 2;
+    }
+    AssetStore assets(assetDir);
+    QString assetErr;
+    if (!assetDir.isEmpty()) {
+        ro.assets = &assets;
+        if (!assets.loadManifest(&assetErr)) {
+            err << assetErr << "\n";
+            return 2;
+        }
+    }
+
+    // the jobserver is kept until exit, the scheduler workers refer to it
+    JobServer* jobs = JobServer::fromEnvironment();
+    if (jobs)
+        Scheduler::setDefaultJobServer(jobs);
+    else if (!threadsGiven && JobServer::underMake())
+        Scheduler::setDefaultThreadCount(1); // make without -j (or recipe not marked +)
+
+    // with several inputs the reads are issued as one batch and each document is converted
+    // as soon as its buffer arrives; -o then names the output directory
+    const bool multi = inPaths.size() > 1;
+    const QString ext = ro.modeIr ? ".ldir" : ".typ";
+    FileBatchReader reader;
+    reader.submit(inPaths);
+    FileBatchReader::Result r;
+    int res = 0;
+    if (!multi) {
+        if (reader.next(&r)) {
+            const QString target = outPath.isEmpty() ? "output" + ext : outPath;
+            if (!r.error.isEmpty()) {
+                err << r.error << "\n";
+                res = 2;
+            } else if (r.path.endsWith(".ldir"))
+                res = renderIr(r.path, r.data, target, ro, false, out, err);
+            else if (ro.stream)
+                res = streamConvert(r.path, r.data, target, ro, false, out, err);
+            else
+                res = convert(r.path, r.data, target, ro, false, out, err);
+        }
+    } else {
+        // the documents pass the phases as a pipeline, one thread per phase, so document N+1 is
+        // parsed while document N is generated; the threads would run outside of the jobserver
+        // tokens, so under make the documents are converted one after the other
+        QStringList stages;
+        stages << "read" << "parse" << "preprocess" << "validate" << "generate" << "write";
+        Pipeline pipeline(stages, Scheduler::instance()->isSerial() || jobs != 0);
+        QElapsedTimer wait;
+        wait.start();
+        while (reader.next(&r)) {
+            const qint64 waited = wait.nsecsElapsed();
+            QElapsedTimer busy;
+            busy.start();
+            const QFileInfo info(r.path);
+            const QString dir = outPath.isEmpty() ? info.absolutePath() : outPath;
+            ConversionJob* job = new ConversionJob(r, dir + "/" + info.completeBaseName() + ext, ro, out, err, &res);
+            r = FileBatchReader::Result();
+            pipeline.sourceDone(busy.nsecsElapsed(), waited);
+            pipeline.push(job);
+            wait.start();
+        }
+        pipeline.finish();
+        if (ro.stats)
+            err << pipeline.report();
+    }
+
+    if (ro.stats && math.lookups() != 0)
+        err << "math: " << math.lookups() << " formulas, " << math.hits() << " from the cache, "
+            << math.size() << " cached\n";
+    if (!mathCachePath.isEmpty() && !math.save(mathCachePath, &mathErr)) {
+        err << mathErr << "\n";
+        if (res == 0)
+            res = 2;
+    }
+    if (ro.assets) {
+        if (!assets.copyAll(&assetErr) || !assets.writeManifest(&assetErr)) {
+            err << assetErr << "\n";
+            if (res == 0)
+                res = 2;
+        }
+        if (ro.stats) {
+            const AssetStore::Stats s = assets.stats();
+            err << "assets: " << s.images << " images in " << s.files << " files, " << s.includes
+                << " includes, " << s.hashed << " hashed; " << s.unchanged << " unchanged, "
+                << s.cloned << " cloned, " << s.copied << " copied\n";
+        }
+    }
+    return res;
 }
@@ -0,0 +1,358 @@
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the LeanDoc document language project.
+*
+* The following is the license that applies to this copy of the
+* file. For a license to use the file under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "LeanDocAssets.h"
+#include "LeanDocScheduler.h"
+#include <QtCore/QCoreApplication>
+#include <QtCore/QFile>
+#include <QtCore/QSaveFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QDir>
+#include <QtCore/QDateTime>
+#include <QtCore/QSet>
+#include <QtCore/QVector>
+#include <QtCore/QCryptographicHash>
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#ifdef Q_OS_LINUX
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+using namespace LeanDoc;
+
+static const char* s_manifest = "manifest.tsv";
+
+enum CopyResult { Unchanged, Cloned, Copied, Failed };
+
+static QByteArray hashFile(const QString& path)
+{
+    QFile f(path);
+    if( !f.open(QIODevice::ReadOnly) )
+        return QByteArray();
+    QCryptographicHash h(QCryptographicHash::Sha1);
+    while( !f.atEnd() ) {
+        const QByteArray buf = f.read(1 << 16);
+        if( buf.isEmpty() )
+            return QByteArray(); // read error
+        h.addData(buf);
+    }
+    return h.result().toHex();
+}
+
+static int copyFile(const QString& from, const QString& to, qint64 size)
+{
+    const QFileInfo dest(to);
+    if( dest.exists() && dest.size() == size )
+        return Unchanged; // the name is the hash of the content
+    // the file is completed under another name, so an interrupted run leaves no partial asset;
+    // the name is per process, since several runs (e.g. under make -j) may share the directory,
+    // and within a run each name is copied once
+    const QString tmp = to + "." + QString::number(QCoreApplication::applicationPid()) + ".part";
+    QFile::remove(tmp);
+    int res = Failed;
+#ifdef Q_OS_UNIX
+    const QByteArray dst = QFile::encodeName(tmp);
+#if defined(Q_OS_LINUX) && defined(FICLONE)
+    // a reflink shares the blocks with the source until one of the two is written; there is
+    // no hard link fallback, since a source rewritten in place would change the stored file
+    // under its hash
+    const QByteArray src = QFile::encodeName(from);
+    const int in = ::open(src.constData(), O_RDONLY | O_CLOEXEC);
+    if( in >= 0 ) {
+        const int out = ::open(dst.constData(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if( out >= 0 ) {
+            if( ::ioctl(out, FICLONE, in) == 0 )
+                res = Cloned;
+            ::close(out);
+            if( res != Cloned )
+                ::unlink(dst.constData());
+        }
+        ::close(in);
+    }
+#endif
+#endif
+    if( res == Failed && QFile::copy(from, tmp) )
+        res = Copied;
+    // another run may have stored the same content meanwhile
+    if( res == Failed )
+        return QFileInfo(to).exists() ? int(Unchanged) : int(Failed);
+#ifdef Q_OS_UNIX
+    const bool renamed = ::rename(dst.constData(), QFile::encodeName(to).constData()) == 0; // atomic
+#else
+    QFile::remove(to);
+    const bool renamed = QFile::rename(tmp, to);
+#endif
+    if( !renamed ) {
+        QFile::remove(tmp);
+        return QFileInfo(to).exists() ? int(Unchanged) : int(Failed);
+    }
+    return res;
+}
+
+// kind, hash, size, mtime, source and name, separated by tabs; see writeManifest()
+static bool readManifest(const QString& path, QHash<QString,AssetStore::Asset>& assets)
+{
+    QFile f(path);
+    if( !f.open(QIODevice::ReadOnly) )
+        return false;
+    while( !f.atEnd() ) {
+        QByteArray line = f.readLine();
+        if( !line.endsWith('\n') )
+            break; // cut off
+        line.chop(1);
+        const QList<QByteArray> cols = line.split('\t');
+        if( cols.size() != 6 || (cols[0] != "image" && cols[0] != "include") )
+            continue;
+        AssetStore::Asset a;
+        a.include = cols[0] == "include";
+        a.hash = cols[1];
+        a.size = cols[2].toLongLong();
+        a.mtime = cols[3].toLongLong();
+        a.source = QString::fromUtf8(cols[4]);
+        a.name = QString::fromUtf8(cols[5]);
+        assets.insert(a.source, a);
+    }
+    return true;
+}
+
+namespace LeanDoc {
+class HashTask : public Task {
+public:
+    explicit HashTask(AssetStore::Asset* a):da(a){}
+    void run() { da->hash = hashFile(da->source); }
+private:
+    AssetStore::Asset* da;
+};
+
+class CopyTask : public Task {
+public:
+    CopyTask(const AssetStore::Asset* a, const QString& to, int* res):da(a),dto(to),dres(res){}
+    void run() { *dres = copyFile(da->source, dto, da->size); }
+private:
+    const AssetStore::Asset* da;
+    QString dto;
+    int* dres;
+};
+}
+
+AssetStore::AssetStore(const QString& dir):ddir(QDir(dir).absolutePath())
+{
+}
+
+bool AssetStore::loadManifest(QString* error)
+{
+    const QString path = ddir + "/" + s_manifest;
+    if( !QFile::exists(path) )
+        return true;
+    if( !readManifest(path, dknown) ) {
+        if( error )
+            *error = "Cannot open file: " + path;
+        return false;
+    }
+    return true;
+}
+
+bool AssetStore::add(const QStringList& images, const QStringList& includes, QString* error)
+{
+    QVector<Asset> todo;
+    {
+        QMutexLocker lock(&dlock);
+        QSet<QString> seen;
+        for( int i = 0; i < images.size() + includes.size(); ++i ) {
+            const bool include = i >= images.size();
+            const QString& path = include ? includes[i - images.size()] : images[i];
+            if( dassets.contains(path) || seen.contains(path) )
+                continue;
+            seen.insert(path);
+            Asset a;
+            a.source = path;
+            a.include = include;
+            todo.append(a);
+        }
+    }
+    if( todo.isEmpty() )
+        return true;
+
+    // the hash of a file which did not change since the manifest was written is reused
+    bool ok = true;
+    int hashed = 0;
+    TaskGroup group;
+    for( int i = 0; i < todo.size(); ++i ) {
+        Asset& a = todo[i];
+        const QFileInfo info(a.source);
+        if( !info.isFile() ) {
+            a.size = -1;
+            if( error && ok )
+                *error = "Cannot read file: " + a.source;
+            ok = false;
+            continue;
+        }
+        a.size = info.size();
+        a.mtime = info.lastModified().toMSecsSinceEpoch();
+        if( a.include )
+            continue;
+        QHash<QString,Asset>::ConstIterator k = dknown.constFind(a.source);
+        if( k != dknown.constEnd() && !k.value().include &&
+                k.value().size == a.size && k.value().mtime == a.mtime ) {
+            a.hash = k.value().hash;
+            continue;
+        }
+        group.spawn(new HashTask(&a));
+        hashed++;
+    }
+    group.wait();
+
+    QMutexLocker lock(&dlock);
+    dstats.hashed += hashed;
+    for( int i = 0; i < todo.size(); ++i ) {
+        Asset& a = todo[i];
+        if( a.size < 0 )
+            continue; // reported above
+        if( !a.include ) {
+            if( a.hash.isEmpty() ) {
+                if( error && ok )
+                    *error = "Cannot read file: " + a.source;
+                ok = false;
+                continue;
+            }
+            const QString suffix = QFileInfo(a.source).suffix().toLower();
+            a.name = QString::fromLatin1(a.hash.left(16));
+            if( !suffix.isEmpty() )
+                a.name += "." + suffix;
+        }
+        dassets.insert(a.source, a);
+    }
+    return ok;
+}
+
+QString AssetStore::nameOf(const QString& source) const
+{
+    QMutexLocker lock(&dlock);
+    QMap<QString,Asset>::ConstIterator i = dassets.constFind(source);
+    return i != dassets.constEnd() ? i.value().name : QString();
+}
+
+bool AssetStore::copyAll(QString* error)
+{
+    if( !QDir().mkpath(ddir) ) {
+        if( error )
+            *error = "Cannot create directory: " + ddir;
+        return false;
+    }
+    QMutexLocker lock(&dlock);
+    // one copy per distinct content
+    QList<const Asset*> files;
+    QSet<QString> names;
+    QMap<QString,Asset>::ConstIterator i;
+    for( i = dassets.constBegin(); i != dassets.constEnd(); ++i ) {
+        if( i.value().include || names.contains(i.value().name) )
+            continue;
+        names.insert(i.value().name);
+        files.append(&i.value());
+    }
+    QVector<int> res(files.size(), Failed);
+    TaskGroup group;
+    for( int j = 0; j < files.size(); ++j )
+        group.spawn(new CopyTask(files[j], ddir + "/" + files[j]->name, &res[j]));
+    group.wait();
+
+    bool ok = true;
+    for( int j = 0; j < res.size(); ++j ) {
+        switch( res[j] ) {
+        case Unchanged: dstats.unchanged++; break;
+        case Cloned: dstats.cloned++; break;
+        case Copied: dstats.copied++; break;
+        default:
+            dstats.failed++;
+            if( error && ok )
+                *error = "Cannot copy file: " + files[j]->source;
+            ok = false;
+            break;
+        }
+    }
+    return ok;
+}
+
+bool AssetStore::writeManifest(QString* error)
+{
+    if( !QDir().mkpath(ddir) ) {
+        if( error )
+            *error = "Cannot create directory: " + ddir;
+        return false;
+    }
+    const QString path = ddir + "/" + s_manifest;
+    QMap<QString,Asset> all;
+    {
+        QMutexLocker lock(&dlock);
+        all = dassets;
+    }
+    // the entries of the other documents are kept, also those another run wrote meanwhile,
+    // as long as the source and the stored image exist
+    QHash<QString,Asset> other = dknown;
+    readManifest(path, other);
+    QHash<QString,Asset>::ConstIterator k;
+    for( k = other.constBegin(); k != other.constEnd(); ++k ) {
+        const Asset& a = k.value();
+        if( !all.contains(a.source) && QFileInfo(a.source).isFile() &&
+                (a.include || QFileInfo(ddir + "/" + a.name).isFile()) )
+            all.insert(a.source, a);
+    }
+
+    // readers see either the old or the new manifest
+    QSaveFile f(path);
+    if( !f.open(QIODevice::WriteOnly) ) {
+        if( error )
+            *error = "Cannot write file: " + path;
+        return false;
+    }
+    f.write("kind\thash\tsize\tmtime\tsource\tname\n");
+    QMap<QString,Asset>::ConstIterator i;
+    for( i = all.constBegin(); i != all.constEnd(); ++i ) {
+        const Asset& a = i.value();
+        f.write((a.include ? "include" : "image") + QByteArray("\t") + a.hash + "\t" +
+                QByteArray::number(a.size) + "\t" + QByteArray::number(a.mtime) + "\t" +
+                a.source.toUtf8() + "\t" + a.name.toUtf8() + "\n");
+    }
+    if( !f.commit() ) {
+        if( error )
+            *error = "Cannot write file: " + path;
+        return false;
+    }
+    return true;
+}
+
+AssetStore::Stats AssetStore::stats() const
+{
+    QMutexLocker lock(&dlock);
+    Stats s = dstats;
+    QSet<QString> names;
+    QMap<QString,Asset>::ConstIterator i;
+    for( i = dassets.constBegin(); i != dassets.constEnd(); ++i ) {
+        if( i.value().include ) {
+            s.includes++;
+        } else {
+            s.images++;
+            names.insert(i.value().name);
+        }
+    }
+    s.files = names.size();
+    return s;
+}
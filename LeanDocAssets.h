@@ -0,0 +1,81 @@
+#ifndef LEANDOC_ASSETS_H
+#define LEANDOC_ASSETS_H
+
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the LeanDoc document language project.
+*
+* The following is the license that applies to this copy of the
+* file. For a license to use the file under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QMap>
+#include <QtCore/QMutex>
+
+namespace LeanDoc {
+
+// The images and included files of the documents of a run. The images are copied into one
+// directory under the hash of their content, so an image used by several documents or under
+// several paths is stored once, and a file which is already there is not copied again. The
+// manifest in the directory lists the files with hash, size and time of modification, also
+// those of earlier runs as long as they exist; the hashes of the files which did not change
+// are taken from it. Several runs can share the directory. Thread-safe; the hashing and the
+// copying run in parallel on the Scheduler.
+class AssetStore {
+public:
+    struct Asset {
+        QString source;  // absolute path
+        QString name;    // in the directory, empty for includes
+        QByteArray hash; // hex SHA-1 of the content, empty for includes
+        qint64 size;
+        qint64 mtime;    // ms since the epoch
+        bool include;    // listed in the manifest, but not copied
+        Asset():size(0),mtime(0),include(false){}
+    };
+    struct Stats {
+        int images, includes, files; // files: the distinct images
+        int hashed;                  // the others were known from the manifest
+        int unchanged, cloned, copied, failed;
+        Stats():images(0),includes(0),files(0),hashed(0),unchanged(0),cloned(0),copied(0),failed(0){}
+    };
+
+    explicit AssetStore(const QString& dir);
+
+    QString dir() const { return ddir; } // absolute
+    bool loadManifest(QString* error = 0); // a missing manifest is an empty one
+
+    // the files of one document; false if one of them cannot be read
+    bool add(const QStringList& images, const QStringList& includes, QString* error = 0);
+    QString nameOf(const QString& source) const; // empty if not an image of the store
+
+    // into dir(): a reflink, otherwise a copy of each distinct image
+    bool copyAll(QString* error = 0);
+    bool writeManifest(QString* error = 0);
+    Stats stats() const;
+
+private:
+    QString ddir;
+    mutable QMutex dlock;
+    QMap<QString,Asset> dassets; // by source, so the manifest is sorted
+    QHash<QString,Asset> dknown; // from the manifest; only read after loadManifest()
+    Stats dstats;
+};
+
+} // namespace LeanDoc
+
+#endif
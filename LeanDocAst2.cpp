@@ -18,8 +18,92 @@
 */
 
 #include "LeanDocAst2.h"
+#include <QtCore/QThread>
+#include <QtCore/QStringList>
+#include <string.h>
 using namespace LeanDoc;
 
+// split on commas but respect quoted strings
+static QStringList splitAttrComma(const QString& s)
+{
+    QStringList out;
+    QString acc;
+    bool inQuote = false;
+    QChar quoteChar;
+    for( int i = 0; i < s.size(); ++i ) {
+        const QChar c = s[i];
+        if( !inQuote && (c == '"' || c == '\'') ) {
+            inQuote = true;
+            quoteChar = c;
+            acc.append(c);
+        } else if( inQuote && c == quoteChar ) {
+            inQuote = false;
+            acc.append(c);
+        } else if( !inQuote && c == ',' ) {
+            out.append(acc);
+            acc.clear();
+        } else {
+            acc.append(c);
+        }
+    }
+    out.append(acc);
+    return out;
+}
+
+AttrMap BlockMeta::parseAttrList(const QString& line)
+{
+    AttrMap res;
+    QString inner = line.trimmed();
+    if( inner.size() >= 2 && inner[0] == '[' && inner[inner.size()-1] == ']' )
+        inner = inner.mid(1, inner.size()-2);
+    if( inner.isEmpty() )
+        return res;
+    const QStringList parts = splitAttrComma(inner);
+
+    int posIdx = 0;
+    for( int i = 0; i < parts.size(); ++i ) {
+        const QString p = parts[i].trimmed();
+        if( p.isEmpty())
+            continue;
+        int eq = p.indexOf('=');
+        if( eq > 0) {
+            res.insert(p.left(eq).trimmed(), p.mid(eq+1).trimmed());
+        } else {
+            res.insert(Atom::positionalKey(posIdx), p);
+            ++posIdx;
+        }
+    }
+    return res;
+}
+
+void BlockMeta::parseAttrLines() const
+{
+    // shared metadata may be accessed by several tasks at once; the first one parses, the
+    // others wait for it, which is short, so other metadata is not held up
+    if( !dparsed.testAndSetAcquire(Unparsed, Parsing) ) {
+        while( dparsed.loadAcquire() != Parsed )
+            QThread::yieldCurrentThread();
+        return;
+    }
+    for( int i = 0; i < attrLines.size(); ++i ) {
+        const AttrMap a = parseAttrList(attrLines[i]);
+        for( AttrMap::ConstIterator it = a.constBegin(); it != a.constEnd(); ++it) {
+            const QString& val = it.value();
+            const bool positional = it.isPositional();
+            // handle AsciiDoc shorthand: [.role] [%option]; [#id] is resolved by the parser
+            if( positional && val.startsWith('#'))
+                continue;
+            else if( positional && val.startsWith('.'))
+                droles.append(val.mid(1));
+            else if( positional && val.startsWith('%'))
+                dattrs.insert(Atom::A_options, val.mid(1));
+            else
+                dattrs.insert(it.key(), val);
+        }
+    }
+    dparsed.storeRelease(Parsed);
+}
+
 const char* Node::nodeKindName(Kind k)
 {
     switch (k) {
@@ -87,6 +171,8 @@ const char* Node::nodeKindName(Kind k)
         return "InlineMacro";
     case K_PassthroughInline:
         return "PassthroughInline";
+    case K_IndexTerm:
+        return "IndexTerm";
     default:
         return "Unknown";
     }
@@ -108,11 +194,18 @@ static void dumpMeta(const BlockMeta* m, QTextStream& out)
         out << " anchorText=\"" << m->anchorText << "\"";
     if( !m->title.isEmpty() )
         out << " title=\"" << m->title << "\"";
-    if( !m->attrs.isEmpty() )
-        out << " attrs=" << m->attrs.size();
+    if( !m->attrs().isEmpty() )
+        out << " attrs=" << m->attrs().size();
 }
 
 void Node::dump(QTextStream &out, int depth)
+{
+    TreeIterator it(this);
+    while( const Node* n = it.next() )
+        n->dumpLine(out, depth + it.depth());
+}
+
+void Node::dumpLine(QTextStream &out, int depth) const
 {
     indent(out, depth);
     out << nodeKindName() << " @" << pos.row;
@@ -144,7 +237,184 @@ void Node::dump(QTextStream &out, int depth)
         out << " kv=" << kv.size();
 
     out << "\n";
+}
+
+void Node::deleteTree(Node* root)
+{
+    QVector<Node*> stack;
+    stack.append(root);
+    while( !stack.isEmpty() ) {
+        Node* n = stack.last();
+        stack.removeLast();
+        if( !n || n->refs.deref() )
+            continue;
+        for( int i = 0; i < n->children.size(); ++i )
+            stack.append(n->children[i]);
+        for( int i = 0; i < n->titleChildren.size(); ++i )
+            stack.append(n->titleChildren[i]);
+        BlockMeta::release(n->meta);
+        delete n;
+    }
+}
 
-    for( int i=0;i<children.size();++i )
-        children[i]->dump(out, depth+1);
+TreeIterator::TreeIterator(const Node* root, int flags):dflags(flags),ddepth(0)
+{
+    if( root ) {
+        Item i;
+        i.node = root;
+        i.depth = 0;
+        dstack.append(i);
+    }
+}
+
+const Node* TreeIterator::next()
+{
+    if( dstack.isEmpty() )
+        return 0;
+    const Item cur = dstack.last();
+    dstack.removeLast();
+    ddepth = cur.depth;
+    const Node* n = cur.node;
+    // pushed in reverse, so the first child is on top
+    Item i;
+    i.depth = cur.depth + 1;
+    if( dflags & WithTitles )
+        for( int k = n->titleChildren.size() - 1; k >= 0; --k ) {
+            i.node = n->titleChildren[k];
+            if( i.node )
+                dstack.append(i);
+        }
+    for( int k = n->children.size() - 1; k >= 0; --k ) {
+        i.node = n->children[k];
+        if( i.node )
+            dstack.append(i);
+    }
+    return n;
+}
+
+uint StringPool::hash(const QChar* str, int len)
+{
+    // FNV-1a over the UTF-16 code units
+    uint h = 2166136261u;
+    for( int i = 0; i < len; ++i ) {
+        h ^= str[i].unicode();
+        h *= 16777619u;
+    }
+    return h;
+}
+
+QString StringPool::intern(const QChar* str, int len)
+{
+    if( len <= 0 )
+        return QString("");
+    if( len > MaxLen )
+        return QString(str, len);
+    dlookups++;
+    if( (dcount + 1) * 2 > dslots.size() )
+        grow();
+    const uint h = hash(str, len);
+    const int mask = dslots.size() - 1;
+    int i = h & mask;
+    for(;;) {
+        Slot& s = dslots[i];
+        if( s.str.isNull() ) {
+            s.hash = h;
+            s.str = QString(str, len);
+            dcount++;
+            return s.str;
+        }
+        if( s.hash == h && s.str.size() == len &&
+                memcmp(s.str.constData(), str, len * sizeof(QChar)) == 0 )
+            return s.str;
+        i = (i + 1) & mask;
+    }
+}
+
+QString StringPool::mid(const QString& s, int pos, int len)
+{
+    if( pos < 0 )
+        pos = 0;
+    if( pos > s.size() )
+        pos = s.size();
+    if( len < 0 || pos + len > s.size() )
+        len = s.size() - pos;
+    return intern(s.constData() + pos, len);
+}
+
+void StringPool::grow()
+{
+    QVector<Slot> old = dslots;
+    dslots = QVector<Slot>(old.isEmpty() ? 256 : old.size() * 2);
+    const int mask = dslots.size() - 1;
+    for( int j = 0; j < old.size(); ++j ) {
+        if( old[j].str.isNull() )
+            continue;
+        int i = old[j].hash & mask;
+        while( !dslots[i].str.isNull() )
+            i = (i + 1) & mask;
+        dslots[i] = old[j];
+    }
+}
+
+static void copyFields(const Node* from, Node* to)
+{
+    to->pos = from->pos;
+    to->meta = from->meta ? from->meta->retain() : 0;
+    to->level = from->level;
+    to->delimKind = from->delimKind;
+    to->listType = from->listType;
+    to->checkState = from->checkState;
+    to->atom = from->atom;
+    to->metaRow = from->metaRow;
+    to->text = from->text;
+    to->name = from->name;
+    to->target = from->target;
+    to->kv = from->kv;
+}
+
+Node* Node::clone(int row) const
+{
+    Node* n = new Node(kind);
+    copyFields(this, n);
+    n->pos = RowCol(row, pos.col);
+    if( meta )
+        n->metaRow = row;
+    for( int i = 0; i < children.size(); ++i )
+        n->children.append(children[i]->clone(row));
+    for( int i = 0; i < titleChildren.size(); ++i )
+        n->titleChildren.append(titleChildren[i]->clone(row));
+    return n;
+}
+
+Node* Node::shallowCopy() const
+{
+    Node* n = new Node(kind);
+    copyFields(this, n);
+    n->children = children;
+    n->titleChildren = titleChildren;
+    for( int i = 0; i < children.size(); ++i )
+        children[i]->retain();
+    for( int i = 0; i < titleChildren.size(); ++i )
+        titleChildren[i]->retain();
+    return n;
+}
+
+Node* Document::shallowCopy() const
+{
+    Document* n = new Document();
+    copyFields(this, n);
+    n->children = children;
+    n->titleChildren = titleChildren;
+    for( int i = 0; i < children.size(); ++i )
+        children[i]->retain();
+    for( int i = 0; i < titleChildren.size(); ++i )
+        titleChildren[i]->retain();
+    return n;
+}
+
+Document::~Document()
+{
+    QHash<QString, BlockMeta*>::ConstIterator it;
+    for( it = sharedMetas.constBegin(); it != sharedMetas.constEnd(); ++it )
+        BlockMeta::release(it.value());
 }
@@ -23,7 +23,11 @@
 #include <QtCore/QString>
 #include <QtCore/QList>
 #include <QtCore/QMap>
+#include <QtCore/QVector>
+#include <QtCore/QHash>
+#include <QtCore/QAtomicInt>
 #include <QtCore/QTextStream>
+#include "LeanDocAtoms.h"
 
 namespace LeanDoc {
 
@@ -35,14 +39,33 @@ struct RowCol {
     RowCol(int l=0,int c=0):row(l),col(c){}
 };
 
+// Metadata consisting of attribute lines only is shared by all blocks with the same lines
+// and must not be modified after parsing; pos is the position of the first occurrence.
+// The attribute lines are only checked by the parser; attrs() and roles() are built from
+// them on first access (thread-safe), so passes which never look at attributes pay nothing.
 struct BlockMeta {
     RowCol pos;
     QString anchorId;
     QString anchorText;
     QString title;
-    QMap<QString, QString> attrs;
-    QList<QString> roles;
-    BlockMeta() {}
+    QList<QString> attrLines; // the raw [...] lines
+    QAtomicInt refs;
+    BlockMeta():refs(1),dparsed(Unparsed) {}
+
+    const AttrMap& attrs() const { parse(); return dattrs; }
+    const QList<QString>& roles() const { parse(); return droles; }
+
+    BlockMeta* retain() { refs.ref(); return this; }
+    static void release(BlockMeta* m) { if( m && !m->refs.deref() ) delete m; }
+
+    static AttrMap parseAttrList(const QString& line); // one [...] line, unchecked
+private:
+    enum { Unparsed, Parsing, Parsed };
+    void parse() const { if( dparsed.loadAcquire() != Parsed ) parseAttrLines(); }
+    void parseAttrLines() const;
+    mutable AttrMap dattrs;
+    mutable QList<QString> droles;
+    mutable QAtomicInt dparsed;
 };
 
 class Node {
@@ -83,7 +106,8 @@ public:
         K_Xref,
         K_AttrRef,
         K_InlineMacro,
-        K_PassthroughInline
+        K_PassthroughInline,
+        K_IndexTerm // text: the term(s) as written; children: the shown content of a flow term
     };
 
     enum DelimKind { DK_None, DK_Listing, DK_Literal, DK_Quote,
@@ -93,7 +117,8 @@ public:
 
     explicit Node(Kind k)
         : kind(k), pos(), meta(0),
-          level(0), delimKind(DK_None), listType(LT_None), checkState(CS_None) {}
+          level(0), delimKind(DK_None), listType(LT_None), checkState(CS_None), atom(0), refs(1),
+          metaRow(0) {}
     virtual ~Node() {}
 
     Kind kind;
@@ -102,6 +127,7 @@ public:
     static const char* nodeKindName(Node::Kind k);
     const char* nodeKindName() const { return nodeKindName(kind); }
     void dump(QTextStream& out, int depth = 0);
+    void dumpLine(QTextStream& out, int depth) const; // this node only
 
     BlockMeta* meta;
 
@@ -109,25 +135,80 @@ public:
     quint8 delimKind;   // DelimKind for K_DelimitedBlock
     quint8 listType;    // ListType for K_List
     quint8 checkState;  // CheckState for K_ListItem
+    quint16 atom;       // Atom of name for K_BlockMacro, K_InlineMacro and K_Directive
+    QAtomicInt refs;    // a node referenced more than once is shared and must not be modified
+    int metaRow;        // first line of meta here; meta->pos is that of its first use, if shared
 
     QString text;       // raw content, literal text
     QString name;       // section title, macro name, admonition label, term text
-    QString target;     // link/macro target or path
-    QMap<QString, QString> kv; // document header attrs, dynamic attrs
+    QString target;     // link/macro target or path, label of an index term
+    KeyValueMap kv; // document header attrs, dynamic attrs
 
     QList<Node*> children;
     QList<Node*> titleChildren; // parsed inline content of section title
     void add(Node* n) { children.append(n); }
+    Node* clone(int row) const; // deep copy, with pos.row of all copied nodes set to row
+    virtual Node* shallowCopy() const; // copy which shares the children and meta
+    Node* retain() { refs.ref(); return this; }
 
-    static void deleteTree(Node* n) {
-        if (!n) return;
-        for (int i=0;i<n->children.size();++i)
-            deleteTree(n->children[i]);
-        for (int i=0;i<n->titleChildren.size();++i)
-            deleteTree(n->titleChildren[i]);
-        delete n->meta;
-        delete n;
-    }
+    // drops one reference; the tree is deleted with the last one, shared subtrees survive
+    static void deleteTree(Node* n);
+};
+
+// Pre-order traversal with an explicit stack, so deep trees cannot overflow the C++ stack.
+// The order is that of the usual recursion: a node, its children, then its titleChildren.
+class TreeIterator {
+public:
+    enum Flags { ChildrenOnly = 0, WithTitles = 1 };
+    explicit TreeIterator(const Node* root, int flags = ChildrenOnly);
+    const Node* next(); // 0 when done
+    int depth() const { return ddepth; } // of the node last returned, the root is 0
+private:
+    struct Item {
+        const Node* node;
+        int depth;
+    };
+    QVector<Item> dstack;
+    int dflags;
+    int ddepth;
+};
+
+// Per-document pool of the short strings the parser extracts (words, IDs, attribute keys and
+// values, macro names). Lookup works directly on the characters of the source line, so a
+// string which already occurs in the document costs no allocation; all nodes share the one
+// implicitly shared copy. Longer strings are rarely repeated and are not pooled.
+class StringPool {
+public:
+    enum { MaxLen = 32 };
+    StringPool():dcount(0),dlookups(0){}
+
+    QString intern(const QChar* str, int len);
+    QString intern(const QString& s) { return s.size() > MaxLen ? s : intern(s.constData(), s.size()); }
+    QString mid(const QString& s, int pos, int len = -1); // like s.mid(pos,len), but pooled
+    static uint hash(const QChar* str, int len);
+    int count() const { return dcount; }
+    int lookups() const { return dlookups; }
+
+private:
+    void grow();
+    struct Slot {
+        uint hash;
+        QString str;
+        Slot():hash(0){}
+    };
+    QVector<Slot> dslots; // open addressing, size is a power of two
+    int dcount;
+    int dlookups;
+};
+
+// root of a parsed document; owns the string pool, which goes away with the tree
+class Document : public Node {
+public:
+    Document():Node(K_Document){}
+    ~Document();
+    Node* shallowCopy() const; // without the parser caches
+    StringPool strings;
+    QHash<QString, BlockMeta*> sharedMetas; // attribute lines -> meta, holds one reference
 };
 
 struct TableCellSpec {
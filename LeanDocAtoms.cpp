@@ -0,0 +1,208 @@
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the LeanDoc document language project.
+*
+* The following is the license that applies to this copy of the
+* file. For a license to use the file under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "LeanDocAtoms.h"
+#include "LeanDocAst2.h"
+#include <QtCore/QVector>
+#include <QtCore/QReadWriteLock>
+#include <string.h>
+using namespace LeanDoc;
+
+// in the order of Atom::Predefined
+static const char* s_predefined[] = {
+    "",
+    "include", "image", "link", "mailto", "xref", "footnote", "latexmath", "anchor",
+    "video", "audio", "kbd", "btn", "menu", "stem",
+    "ifdef", "ifndef", "ifeval", "endif",
+    "positional0", "positional1", "positional2", "positional3", "positional4", "positional5",
+    "id", "role", "options", "cols", "width", "height", "source", "language", "linenums",
+    "header", "subs"
+};
+
+namespace {
+class AtomTable {
+public:
+    QReadWriteLock lock;
+    QVector<QString> names;  // atom -> name
+    QVector<quint16> slots;  // open addressing, 0 is empty
+
+    AtomTable()
+    {
+        Q_ASSERT( sizeof(s_predefined) / sizeof(s_predefined[0]) == Atom::MaxPredefined );
+        slots.fill(0, 1024);
+        names.append(QString());
+        for( int i = 1; i < Atom::MaxPredefined; ++i ) {
+            const QString s = QString::fromLatin1(s_predefined[i]);
+            insert(s.constData(), s.size());
+        }
+    }
+
+    int find(const QChar* str, int len, uint h) const
+    {
+        const int mask = slots.size() - 1;
+        int i = h & mask;
+        while( slots[i] != 0 ) {
+            const QString& n = names[slots[i]];
+            if( n.size() == len && memcmp(n.constData(), str, len * sizeof(QChar)) == 0 )
+                return i;
+            i = (i + 1) & mask;
+        }
+        return i;
+    }
+
+    quint16 insert(const QChar* str, int len)
+    {
+        if( names.size() >= 0xffff )
+            return Atom::Null;
+        if( names.size() * 2 > slots.size() ) {
+            slots.fill(0, slots.size() * 2);
+            for( int a = 1; a < names.size(); ++a )
+                slots[find(names[a].constData(), names[a].size(),
+                           StringPool::hash(names[a].constData(), names[a].size()))] = a;
+        }
+        const quint16 a = names.size();
+        names.append(QString(str, len));
+        slots[find(str, len, StringPool::hash(str, len))] = a;
+        return a;
+    }
+};
+}
+
+static AtomTable& table()
+{
+    static AtomTable t;
+    return t;
+}
+
+quint16 Atom::lookup(const QChar* str, int len)
+{
+    if( len <= 0 )
+        return Null;
+    AtomTable& t = table();
+    const uint h = StringPool::hash(str, len);
+    QReadLocker lock(&t.lock);
+    return t.slots[t.find(str, len, h)];
+}
+
+quint16 Atom::intern(const QChar* str, int len)
+{
+    const quint16 a = lookup(str, len);
+    if( a != Null || len <= 0 )
+        return a;
+    AtomTable& t = table();
+    QWriteLocker lock(&t.lock);
+    const quint16 b = t.slots[t.find(str, len, StringPool::hash(str, len))];
+    if( b != Null ) // interned by another thread meanwhile
+        return b;
+    return t.insert(str, len);
+}
+
+QString Atom::name(quint16 atom)
+{
+    AtomTable& t = table();
+    QReadLocker lock(&t.lock);
+    if( atom < t.names.size() )
+        return t.names[atom];
+    return QString();
+}
+
+quint16 Atom::positional(int i)
+{
+    if( i >= 0 && i <= A_positional5 - A_positional0 )
+        return A_positional0 + i;
+    return Null;
+}
+
+bool Atom::isPositional(quint16 atom)
+{
+    return atom >= A_positional0 && atom <= A_positional5;
+}
+
+QString Atom::positionalKey(int i)
+{
+    return i >= 0 && i <= A_positional5 - A_positional0 ? name(A_positional0 + i) :
+                                                         QString("positional%1").arg(i);
+}
+
+int AttrMap::indexOf(quint16 atom) const
+{
+    if( atom == Atom::Null )
+        return -1;
+    for( int i = 0; i < dentries.size(); ++i )
+        if( dentries[i].atom == atom )
+            return i;
+    return -1;
+}
+
+int AttrMap::indexOf(const QString& key) const
+{
+    const quint16 atom = Atom::lookup(key);
+    if( atom != Atom::Null )
+        return indexOf(atom);
+    for( int i = 0; i < dentries.size(); ++i )
+        if( dentries[i].atom == Atom::Null && dentries[i].key == key )
+            return i;
+    return -1;
+}
+
+QString AttrMap::value(quint16 atom, const QString& def) const
+{
+    const int i = indexOf(atom);
+    return i < 0 ? def : dentries[i].value;
+}
+
+QString AttrMap::value(const QString& key, const QString& def) const
+{
+    const int i = indexOf(key);
+    return i < 0 ? def : dentries[i].value;
+}
+
+void AttrMap::insert(const QString& key, const QString& value)
+{
+    const quint16 atom = Atom::lookup(key);
+    insert(atom == Atom::Null ? key : Atom::name(atom), atom, value);
+}
+
+void AttrMap::insert(quint16 atom, const QString& value)
+{
+    insert(Atom::name(atom), atom, value);
+}
+
+void AttrMap::insert(const QString& key, quint16 atom, const QString& value)
+{
+    int i = 0;
+    while( i < dentries.size() && dentries[i].key < key )
+        ++i;
+    if( i < dentries.size() && dentries[i].key == key ) {
+        dentries[i].value = value;
+        return;
+    }
+    Entry e;
+    e.key = key;
+    e.value = value;
+    e.atom = atom;
+    dentries.insert(i, e);
+}
+
+void AttrMap::remove(quint16 atom)
+{
+    const int i = indexOf(atom);
+    if( i >= 0 )
+        dentries.remove(i);
+}
@@ -0,0 +1,140 @@
+#ifndef LEANDOC_ATOMS_H
+#define LEANDOC_ATOMS_H
+
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the LeanDoc document language project.
+*
+* The following is the license that applies to this copy of the
+* file. For a license to use the file under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include <QtCore/QString>
+#include <QtCore/QVarLengthArray>
+#include <QtCore/QMap>
+
+namespace LeanDoc {
+
+// Process-wide symbol table for macro names, directive names and attribute keys. Each
+// known name is mapped to a small integer once, so the passes compare and look up
+// integers instead of strings. The well-known names have fixed values; only these and the
+// names of registered macros are interned, the names from the documents are just looked up,
+// so the table does not grow with the input. Interning is thread-safe.
+class Atom {
+public:
+    enum Predefined {
+        Null,
+        // block and inline macros
+        A_include, A_image, A_link, A_mailto, A_xref, A_footnote, A_latexmath, A_anchor,
+        A_video, A_audio, A_kbd, A_btn, A_menu, A_stem,
+        // directives
+        A_ifdef, A_ifndef, A_ifeval, A_endif,
+        // attribute keys
+        A_positional0, A_positional1, A_positional2, A_positional3, A_positional4, A_positional5,
+        A_id, A_role, A_options, A_cols, A_width, A_height, A_source, A_language, A_linenums,
+        A_header, A_subs,
+        MaxPredefined
+    };
+
+    static quint16 intern(const QChar* str, int len); // Null if the table is full
+    static quint16 intern(const QString& s) { return intern(s.constData(), s.size()); }
+    static quint16 lookup(const QChar* str, int len); // Null if not interned yet
+    static quint16 lookup(const QString& s) { return lookup(s.constData(), s.size()); }
+    static QString name(quint16 atom); // shared, no allocation
+    static quint16 positional(int i); // Null beyond A_positional5
+    static bool isPositional(quint16 atom);
+    static QString positionalKey(int i); // "positional<i>", also beyond A_positional5
+};
+
+// Replaces QMap<QString,QString> for the attribute maps of the AST, which usually hold one
+// to three entries. The entries are kept inline in a vector sorted by key name, so iteration
+// order is the same as with QMap; lookups compare atoms.
+class AttrMap {
+public:
+    struct Entry {
+        QString key;
+        QString value;
+        quint16 atom; // Null if the key is not a known name
+        Entry():atom(Atom::Null){}
+    };
+
+    class ConstIterator {
+    public:
+        ConstIterator(const AttrMap* m = 0, int i = 0):dmap(m),di(i){}
+        const QString& key() const { return dmap->dentries[di].key; }
+        const QString& value() const { return dmap->dentries[di].value; }
+        quint16 atom() const { return dmap->dentries[di].atom; }
+        bool isPositional() const
+        {
+            return Atom::isPositional(atom()) || (atom() == Atom::Null && key().startsWith("positional"));
+        }
+        ConstIterator& operator++() { ++di; return *this; }
+        bool operator==(const ConstIterator& rhs) const { return di == rhs.di; }
+        bool operator!=(const ConstIterator& rhs) const { return di != rhs.di; }
+    private:
+        const AttrMap* dmap;
+        int di;
+    };
+
+    bool isEmpty() const { return dentries.isEmpty(); }
+    int size() const { return dentries.size(); }
+    void clear() { dentries.clear(); }
+
+    void insert(const QString& key, const QString& value);
+    void insert(quint16 atom, const QString& value);
+    void remove(quint16 atom);
+
+    bool contains(quint16 atom) const { return indexOf(atom) >= 0; }
+    bool contains(const QString& key) const { return indexOf(key) >= 0; }
+    QString value(quint16 atom, const QString& def = QString()) const;
+    QString value(const QString& key, const QString& def = QString()) const;
+
+    ConstIterator constBegin() const { return ConstIterator(this, 0); }
+    ConstIterator constEnd() const { return ConstIterator(this, dentries.size()); }
+    const Entry& at(int i) const { return dentries[i]; }
+
+    int indexOf(quint16 atom) const;
+    int indexOf(const QString& key) const;
+private:
+    void insert(const QString& key, quint16 atom, const QString& value);
+    QVarLengthArray<Entry, 3> dentries;
+};
+
+// The attributes of nodes, which only the document and tables have: the size of a pointer
+// while empty, and a sorted map, since the document header can have many attributes; the
+// atom overloads look up by the name of the atom.
+class KeyValueMap {
+public:
+    typedef QMap<QString,QString>::const_iterator ConstIterator;
+
+    bool isEmpty() const { return d.isEmpty(); }
+    int size() const { return d.size(); }
+
+    void insert(const QString& key, const QString& value) { d.insert(key, value); }
+    void insert(quint16 atom, const QString& value) { d.insert(Atom::name(atom), value); }
+
+    bool contains(quint16 atom) const { return d.contains(Atom::name(atom)); }
+    bool contains(const QString& key) const { return d.contains(key); }
+    QString value(quint16 atom, const QString& def = QString()) const { return d.value(Atom::name(atom), def); }
+    QString value(const QString& key, const QString& def = QString()) const { return d.value(key, def); }
+
+    ConstIterator constBegin() const { return d.constBegin(); }
+    ConstIterator constEnd() const { return d.constEnd(); }
+private:
+    QMap<QString,QString> d;
+};
+
+} // namespace LeanDoc
+
+#endif
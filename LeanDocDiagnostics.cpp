@@ -0,0 +1,185 @@
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the LeanDoc document language project.
+*
+* The following is the license that applies to this copy of the
+* file. For a license to use the file under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "LeanDocDiagnostics.h"
+#include <QtCore/QTextStream>
+#include <QtCore/QMutexLocker>
+#include <algorithm>
+#include <limits.h>
+using namespace LeanDoc;
+
+bool Diagnostic::operator<(const Diagnostic& rhs) const
+{
+    if( line != rhs.line )
+        return line < rhs.line;
+    if( col != rhs.col )
+        return col < rhs.col;
+    if( phase != rhs.phase )
+        return phase < rhs.phase;
+    return seq < rhs.seq;
+}
+
+QString Diagnostic::toString(bool withFile) const
+{
+    QString res;
+    if( withFile && !file.isEmpty() )
+        res = file + ": ";
+    if( phase == Generate )
+        res += "Typst generation error";
+    else
+        res += level == Error ? "Error" : "Warning";
+    res += " at line " + QString::number(line);
+    if( col > 0 )
+        res += ", column " + QString::number(col);
+    return res + ": " + message;
+}
+
+DiagnosticSink::DiagnosticSink(const QString& file):dfile(file),dpendingMin(INT_MAX),dout(0),dwithFile(false),
+    dlimit(0),dwritten(0),dseq(0)
+{
+    for( int i = 0; i < Diagnostic::MaxPhase; ++i )
+        dprogress[i] = -1;
+}
+
+DiagnosticSink::~DiagnosticSink()
+{
+}
+
+void DiagnosticSink::setStream(QTextStream* out, bool withFile)
+{
+    QMutexLocker lock(&dlock);
+    dout = out;
+    dwithFile = withFile;
+}
+
+void DiagnosticSink::expectPhase(Diagnostic::Phase p)
+{
+    QMutexLocker lock(&dlock);
+    dprogress[p] = 0;
+}
+
+void DiagnosticSink::append(Diagnostic& d)
+{
+    if( d.file.isEmpty() )
+        d.file = dfile;
+    if( d.level == Diagnostic::Error )
+        derrors.ref();
+    dall.append(d);
+    if( dout ) {
+        dpending.append(d);
+        if( d.line < dpendingMin )
+            dpendingMin = d.line;
+    }
+}
+
+void DiagnosticSink::report(const Diagnostic& d)
+{
+    QMutexLocker lock(&dlock);
+    Diagnostic tmp = d;
+    if( tmp.seq == 0 )
+        tmp.seq = ++dseq;
+    append(tmp);
+    stream();
+}
+
+void DiagnosticSink::setProgress(Diagnostic::Phase p, int line)
+{
+    QMutexLocker lock(&dlock);
+    if( dprogress[p] < 0 || line <= dprogress[p] )
+        return;
+    dprogress[p] = line;
+    stream();
+}
+
+void DiagnosticSink::endPhase(Diagnostic::Phase p)
+{
+    QMutexLocker lock(&dlock);
+    if( dprogress[p] < 0 )
+        return;
+    dprogress[p] = INT_MAX;
+    stream();
+}
+
+void DiagnosticSink::finish()
+{
+    QMutexLocker lock(&dlock);
+    for( int i = 0; i < Diagnostic::MaxPhase; ++i )
+        if( dprogress[i] >= 0 )
+            dprogress[i] = INT_MAX;
+    stream();
+}
+
+void DiagnosticSink::stream()
+{
+    // everything before the slowest expected phase is complete and can be written
+    if( dout == 0 || dpending.isEmpty() )
+        return;
+    int mark = INT_MAX;
+    for( int i = 0; i < Diagnostic::MaxPhase; ++i )
+        if( dprogress[i] >= 0 && dprogress[i] < mark )
+            mark = dprogress[i];
+    if( mark != INT_MAX && dpendingMin >= mark )
+        return; // nothing can be written yet; don't sort on every report
+    std::stable_sort(dpending.begin(), dpending.end());
+    int n = 0;
+    while( n < dpending.size() && (mark == INT_MAX || dpending[n].line < mark) ) {
+        // beyond the limit only the count is reported, by the caller
+        if( dlimit <= 0 || dwritten < dlimit )
+            *dout << dpending[n].toString(dwithFile) << "\n";
+        if( dpending[n].level == Diagnostic::Error )
+            dwritten++;
+        n++;
+    }
+    if( n == 0 )
+        return;
+    dpending = dpending.mid(n);
+    dpendingMin = dpending.isEmpty() ? INT_MAX : dpending.first().line;
+    dout->flush();
+}
+
+int DiagnosticSink::count()
+{
+    QMutexLocker lock(&dlock);
+    return dall.size();
+}
+
+QList<Diagnostic> DiagnosticSink::diagnostics()
+{
+    QMutexLocker lock(&dlock);
+    QList<Diagnostic> res = dall;
+    std::stable_sort(res.begin(), res.end());
+    return res;
+}
+
+void DiagnosticSink::Buffer::report(const Diagnostic& d)
+{
+    dpending.append(d);
+    dpending.last().seq = dbase + (++dnext);
+}
+
+void DiagnosticSink::Buffer::flush()
+{
+    if( dsink == 0 || dpending.isEmpty() )
+        return;
+    QMutexLocker lock(&dsink->dlock);
+    for( int i = 0; i < dpending.size(); ++i )
+        dsink->append(dpending[i]);
+    dpending.clear();
+    dsink->stream();
+}
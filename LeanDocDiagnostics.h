@@ -0,0 +1,113 @@
+#ifndef LEANDOC_DIAGNOSTICS_H
+#define LEANDOC_DIAGNOSTICS_H
+
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the LeanDoc document language project.
+*
+* The following is the license that applies to this copy of the
+* file. For a license to use the file under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include <QtCore/QString>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QAtomicInt>
+
+class QTextStream;
+
+namespace LeanDoc {
+
+struct Diagnostic {
+    enum Level { Warning, Error };
+    enum Phase { Decode, Parse, Preprocess, Validate, Generate, MaxPhase };
+    Level level;
+    quint8 phase;
+    int line;
+    int col;     // 0 if not known
+    qint64 seq;  // order among diagnostics at the same position
+    QString file;
+    QString message;
+    Diagnostic():level(Warning),phase(Validate),line(0),col(0),seq(0){}
+    Diagnostic(Level lv, int l, const QString& m):level(lv),phase(Validate),line(l),col(0),seq(0),message(m){}
+    Diagnostic(Level lv, Phase ph, int l, int c, const QString& m):
+        level(lv),phase(ph),line(l),col(c),seq(0),message(m){}
+
+    bool operator<(const Diagnostic& rhs) const; // document order
+    QString toString(bool withFile = false) const;
+};
+
+// Collects the diagnostics of all phases of one document. Reporting is thread-safe; tasks
+// should collect into a Buffer, which takes the lock only once when it is flushed. The
+// diagnostics can be streamed in document order while the phases are still running:
+// a diagnostic is written as soon as every expected phase has progressed beyond its line.
+class DiagnosticSink {
+public:
+    explicit DiagnosticSink(const QString& file = QString());
+    ~DiagnosticSink();
+
+    void setErrorLimit(int n) { dlimit = n; } // 0: unlimited
+    void setStream(QTextStream* out, bool withFile = false);
+    void expectPhase(Diagnostic::Phase p);
+
+    void report(const Diagnostic& d);
+    void report(Diagnostic::Level lv, Diagnostic::Phase ph, int line, int col, const QString& msg)
+        { report(Diagnostic(lv, ph, line, col, msg)); }
+
+    void setProgress(Diagnostic::Phase p, int line); // the phase will not report before line
+    void endPhase(Diagnostic::Phase p);
+    void finish(); // ends all phases and writes the remaining diagnostics
+
+    bool aborted() const { return dlimit > 0 && derrors.loadAcquire() >= dlimit; }
+    int errorCount() const { return derrors.loadAcquire(); }
+    int count();
+    QList<Diagnostic> diagnostics(); // all diagnostics, in document order
+
+    class Buffer {
+    public:
+        // ordinal makes the order of buffers deterministic, e.g. the index of the task
+        Buffer(DiagnosticSink* s, int ordinal):dsink(s),dbase(qint64(ordinal + 1) << 32),dnext(0){}
+        ~Buffer() { flush(); }
+        void report(const Diagnostic& d);
+        void report(Diagnostic::Level lv, Diagnostic::Phase ph, int line, int col, const QString& msg)
+            { report(Diagnostic(lv, ph, line, col, msg)); }
+        void flush();
+    private:
+        DiagnosticSink* dsink;
+        QList<Diagnostic> dpending;
+        qint64 dbase;
+        int dnext;
+    };
+
+private:
+    void append(Diagnostic& d);
+    void stream();
+
+    QMutex dlock;
+    QString dfile;
+    QList<Diagnostic> dall;     // in order of arrival
+    QList<Diagnostic> dpending; // reported but not yet streamed
+    int dpendingMin;            // smallest line in dpending
+    int dprogress[Diagnostic::MaxPhase]; // -1: phase not expected
+    QTextStream* dout;
+    bool dwithFile;
+    int dlimit;
+    int dwritten; // errors streamed so far
+    qint64 dseq;
+    QAtomicInt derrors;
+};
+
+} // namespace LeanDoc
+
+#endif
@@ -0,0 +1,487 @@
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the LeanDoc document language project.
+*
+* The following is the license that applies to this copy of the
+* file. For a license to use the file under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "LeanDocFileIo.h"
+#include <QtCore/QThread>
+#include <QtCore/QFile>
+#include <QtCore/QVector>
+#include <limits.h>
+#ifdef Q_OS_UNIX
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+#ifdef Q_OS_LINUX
+#include <linux/version.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,6,0)
+#define LEANDOC_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <string.h>
+#endif
+#endif
+using namespace LeanDoc;
+
+namespace LeanDoc {
+
+class FileReadWorker : public QThread {
+public:
+    FileReadWorker(FileBatchReader* r, bool uring):dr(r),during(uring){}
+protected:
+    void run()
+    {
+        if( during )
+            dr->uringLoop();
+        else
+            dr->workerLoop();
+    }
+private:
+    FileBatchReader* dr;
+    bool during;
+};
+
+#ifdef LEANDOC_IO_URING
+
+// minimal io_uring binding over the raw system calls; liburing is not required
+class IoUring {
+public:
+    IoUring():dfd(-1),dsq(MAP_FAILED),dcq(MAP_FAILED),dsqes(MAP_FAILED),dsqLen(0),dcqLen(0),dsqesLen(0),dpending(0){}
+    ~IoUring()
+    {
+        if( dsqes != MAP_FAILED )
+            ::munmap(dsqes, dsqesLen);
+        if( dcq != MAP_FAILED && dcq != dsq )
+            ::munmap(dcq, dcqLen);
+        if( dsq != MAP_FAILED )
+            ::munmap(dsq, dsqLen);
+        if( dfd >= 0 )
+            ::close(dfd);
+    }
+
+    bool init(unsigned entries)
+    {
+        io_uring_params p;
+        memset(&p, 0, sizeof(p));
+        dfd = int(::syscall(__NR_io_uring_setup, entries, &p));
+        if( dfd < 0 )
+            return false; // ENOSYS on old kernels, EPERM when blocked by seccomp or sysctl
+        dsqLen = p.sq_off.array + p.sq_entries * sizeof(__u32);
+        dcqLen = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        if( p.features & IORING_FEAT_SINGLE_MMAP ) {
+            if( dcqLen > dsqLen )
+                dsqLen = dcqLen;
+            dcqLen = dsqLen;
+        }
+        dsq = ::mmap(0, dsqLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, dfd, IORING_OFF_SQ_RING);
+        if( dsq == MAP_FAILED )
+            return false;
+        if( p.features & IORING_FEAT_SINGLE_MMAP )
+            dcq = dsq;
+        else {
+            dcq = ::mmap(0, dcqLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, dfd, IORING_OFF_CQ_RING);
+            if( dcq == MAP_FAILED )
+                return false;
+        }
+        dsqesLen = p.sq_entries * sizeof(io_uring_sqe);
+        dsqes = ::mmap(0, dsqesLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, dfd, IORING_OFF_SQES);
+        if( dsqes == MAP_FAILED )
+            return false;
+
+        char* sq = static_cast<char*>(dsq);
+        char* cq = static_cast<char*>(dcq);
+        dsqTail = reinterpret_cast<__u32*>(sq + p.sq_off.tail);
+        dsqMask = *reinterpret_cast<__u32*>(sq + p.sq_off.ring_mask);
+        dsqArray = reinterpret_cast<__u32*>(sq + p.sq_off.array);
+        dcqHead = reinterpret_cast<__u32*>(cq + p.cq_off.head);
+        dcqTail = reinterpret_cast<__u32*>(cq + p.cq_off.tail);
+        dcqMask = *reinterpret_cast<__u32*>(cq + p.cq_off.ring_mask);
+        dcqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+        dentries = p.sq_entries;
+        return true;
+    }
+
+    // the caller never has more operations in flight than there are entries, so the
+    // submission queue cannot overflow
+    io_uring_sqe* push()
+    {
+        const __u32 tail = *dsqTail;
+        const __u32 idx = tail & dsqMask;
+        io_uring_sqe* sqe = static_cast<io_uring_sqe*>(dsqes) + idx;
+        memset(sqe, 0, sizeof(*sqe));
+        dsqArray[idx] = idx;
+        __atomic_store_n(dsqTail, tail + 1, __ATOMIC_RELEASE);
+        dpending++;
+        return sqe;
+    }
+
+    // submits the queued operations and optionally waits for at least one completion
+    bool enter(bool wait)
+    {
+        for(;;) {
+            const int n = int(::syscall(__NR_io_uring_enter, dfd, dpending, wait ? 1 : 0,
+                                        wait ? IORING_ENTER_GETEVENTS : 0, 0, 0));
+            if( n >= 0 ) {
+                dpending -= n;
+                return true;
+            }
+            if( errno != EINTR && errno != EAGAIN && errno != EBUSY )
+                return false;
+        }
+    }
+
+    bool peek(io_uring_cqe* cqe)
+    {
+        const __u32 head = *dcqHead;
+        if( head == __atomic_load_n(dcqTail, __ATOMIC_ACQUIRE) )
+            return false;
+        *cqe = dcqes[head & dcqMask];
+        __atomic_store_n(dcqHead, head + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    unsigned entries() const { return dentries; }
+
+private:
+    int dfd;
+    void* dsq;
+    void* dcq;
+    void* dsqes;
+    size_t dsqLen, dcqLen, dsqesLen;
+    __u32* dsqTail;
+    __u32* dsqArray;
+    __u32 dsqMask;
+    __u32* dcqHead;
+    __u32* dcqTail;
+    __u32 dcqMask;
+    io_uring_cqe* dcqes;
+    unsigned dentries;
+    unsigned dpending;
+};
+
+#else
+
+class IoUring {};
+
+#endif
+
+} // namespace LeanDoc
+
+FileBatchReader::FileBatchReader(int workers, int batchSize):
+    dnextIndex(0),doutstanding(0),dworkerCount(workers < 1 ? 1 : workers),
+    dbatchSize(batchSize < 1 ? 1 : batchSize),dquit(false),dstarted(false),dring(0)
+{
+}
+
+FileBatchReader::~FileBatchReader()
+{
+    dlock.lock();
+    dquit = true;
+    dsubmitted.wakeAll();
+    dlock.unlock();
+    for( int i = 0; i < dworkers.size(); ++i ) {
+        dworkers[i]->wait();
+        delete dworkers[i];
+    }
+    delete dring;
+}
+
+void FileBatchReader::submit(const QStringList& paths)
+{
+    QMutexLocker lock(&dlock);
+    for( int i = 0; i < paths.size(); ++i ) {
+        Request req;
+        req.index = dnextIndex++;
+        req.path = paths[i];
+        dqueue.append(req);
+    }
+    doutstanding += paths.size();
+    if( !dstarted )
+        start();
+    dsubmitted.wakeAll();
+}
+
+void FileBatchReader::start()
+{
+    dstarted = true;
+#ifdef LEANDOC_IO_URING
+    dring = new IoUring();
+    if( dring->init(dbatchSize) ) {
+        if( int(dring->entries()) < dbatchSize )
+            dbatchSize = dring->entries();
+        dworkers.append(new FileReadWorker(this, true));
+        dworkers.last()->start();
+        return;
+    }
+    delete dring;
+    dring = 0;
+#endif
+    for( int i = 0; i < dworkerCount; ++i ) {
+        dworkers.append(new FileReadWorker(this, false));
+        dworkers.last()->start();
+    }
+}
+
+const char* FileBatchReader::backendName() const
+{
+    if( !dstarted )
+        return "none";
+    return dring ? "io_uring" : "pread";
+}
+
+bool FileBatchReader::next(Result* r)
+{
+    QMutexLocker lock(&dlock);
+    while( ddone.isEmpty() && doutstanding > 0 )
+        dcompleted.wait(&dlock);
+    if( ddone.isEmpty() )
+        return false;
+    *r = ddone.takeFirst();
+    doutstanding--;
+    return true;
+}
+
+bool FileBatchReader::takeRequest(Request* req, bool wait)
+{
+    QMutexLocker lock(&dlock);
+    while( wait && dqueue.isEmpty() && !dquit )
+        dsubmitted.wait(&dlock);
+    if( dqueue.isEmpty() )
+        return false;
+    *req = dqueue.takeFirst();
+    return true;
+}
+
+void FileBatchReader::complete(const Result& r)
+{
+    QMutexLocker lock(&dlock);
+    ddone.append(r);
+    dcompleted.wakeOne();
+}
+
+void FileBatchReader::workerLoop()
+{
+    Request req;
+    while( takeRequest(&req, true) ) {
+        Result r;
+        r.index = req.index;
+        readFile(req.path, &r);
+        complete(r);
+    }
+}
+
+bool FileBatchReader::readFile(const QString& path, Result* r)
+{
+    r->path = path;
+    r->data.clear();
+    r->error.clear();
+#ifdef Q_OS_UNIX
+    const int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_CLOEXEC);
+    if( fd < 0 ) {
+        r->error = "Cannot open file: " + path;
+        return false;
+    }
+    struct stat st;
+    if( ::fstat(fd, &st) != 0 || st.st_size > INT_MAX ) {
+        ::close(fd);
+        r->error = "Cannot read file: " + path;
+        return false;
+    }
+    r->data.resize(int(st.st_size));
+    qint64 done = 0;
+    while( done < st.st_size ) {
+        const ssize_t n = ::pread(fd, r->data.data() + done, size_t(st.st_size - done), off_t(done));
+        if( n < 0 && errno == EINTR )
+            continue;
+        if( n < 0 ) {
+            ::close(fd);
+            r->data.clear();
+            r->error = "Cannot read file: " + path;
+            return false;
+        }
+        if( n == 0 )
+            break; // truncated meanwhile
+        done += n;
+    }
+    ::close(fd);
+    r->data.resize(int(done));
+    return true;
+#else
+    QFile f(path);
+    if( !f.open(QIODevice::ReadOnly) ) {
+        r->error = "Cannot open file: " + path;
+        return false;
+    }
+    r->data = f.readAll();
+    return true;
+#endif
+}
+
+#ifdef LEANDOC_IO_URING
+
+namespace {
+struct Slot {
+    enum Phase { Free, Opening, Reading };
+    int phase;
+    int fd;
+    qint64 size;
+    qint64 done;
+    QByteArray cpath; // must stay alive until the open has completed
+    FileBatchReader::Result res;
+    Slot():phase(Free),fd(-1),size(0),done(0){}
+};
+}
+
+static void prepRead(IoUring* ring, Slot& s, int slot)
+{
+    io_uring_sqe* sqe = ring->push();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = s.fd;
+    sqe->addr = quint64(quintptr(s.res.data.data() + s.done));
+    sqe->len = unsigned(s.size - s.done);
+    sqe->off = quint64(s.done);
+    sqe->user_data = quint64(slot);
+}
+
+void FileBatchReader::uringLoop()
+{
+    // a single thread keeps up to dbatchSize opens and reads in flight; a file goes through
+    // OPENAT, an fstat for the size, then one READ into its final buffer (more if short)
+    QVector<Slot> slots(dbatchSize);
+    QList<int> freeSlots;
+    for( int i = dbatchSize - 1; i >= 0; --i )
+        freeSlots.append(i);
+    int inFlight = 0;
+
+    for(;;) {
+        Request req;
+        while( !freeSlots.isEmpty() && takeRequest(&req, inFlight == 0) ) {
+            const int i = freeSlots.takeLast();
+            Slot& s = slots[i];
+            s.phase = Slot::Opening;
+            s.fd = -1;
+            s.size = s.done = 0;
+            s.cpath = QFile::encodeName(req.path);
+            s.res = Result();
+            s.res.index = req.index;
+            s.res.path = req.path;
+            io_uring_sqe* sqe = dring->push();
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = quint64(quintptr(s.cpath.constData()));
+            sqe->open_flags = O_RDONLY | O_CLOEXEC;
+            sqe->user_data = quint64(i);
+            inFlight++;
+        }
+        if( inFlight == 0 )
+            return; // quit requested and nothing left to do
+
+        if( !dring->enter(true) ) {
+            // the ring became unusable; finish the pending files synchronously
+            for( int i = 0; i < slots.size(); ++i ) {
+                Slot& s = slots[i];
+                if( s.phase == Slot::Free )
+                    continue;
+                if( s.fd >= 0 )
+                    ::close(s.fd);
+                readFile(s.res.path, &s.res);
+                complete(s.res);
+                s.phase = Slot::Free;
+            }
+            while( takeRequest(&req, true) ) {
+                Result r;
+                r.index = req.index;
+                readFile(req.path, &r);
+                complete(r);
+            }
+            return;
+        }
+
+        io_uring_cqe cqe;
+        while( dring->peek(&cqe) ) {
+            const int i = int(cqe.user_data);
+            Slot& s = slots[i];
+            bool finished = false;
+            if( cqe.res == -EINVAL || cqe.res == -EOPNOTSUPP ) {
+                // kernel predates the opcode
+                if( s.fd >= 0 )
+                    ::close(s.fd);
+                s.fd = -1;
+                readFile(s.res.path, &s.res);
+                finished = true;
+            } else if( s.phase == Slot::Opening ) {
+                struct stat st;
+                if( cqe.res < 0 ) {
+                    s.res.error = "Cannot open file: " + s.res.path;
+                    finished = true;
+                } else if( ::fstat(cqe.res, &st) != 0 || st.st_size > INT_MAX ) {
+                    ::close(cqe.res);
+                    s.res.error = "Cannot read file: " + s.res.path;
+                    finished = true;
+                } else if( st.st_size == 0 ) {
+                    ::close(cqe.res);
+                    finished = true;
+                } else {
+                    s.fd = cqe.res;
+                    s.size = st.st_size;
+                    s.res.data.resize(int(s.size));
+                    s.phase = Slot::Reading;
+                    prepRead(dring, s, i);
+                }
+            } else {
+                if( cqe.res < 0 && cqe.res != -EINTR && cqe.res != -EAGAIN ) {
+                    s.res.data.clear();
+                    s.res.error = "Cannot read file: " + s.res.path;
+                    finished = true;
+                } else {
+                    if( cqe.res > 0 )
+                        s.done += cqe.res;
+                    if( cqe.res == 0 || s.done >= s.size ) {
+                        s.res.data.resize(int(s.done));
+                        finished = true;
+                    } else
+                        prepRead(dring, s, i); // short read
+                }
+                if( finished ) {
+                    ::close(s.fd);
+                    s.fd = -1;
+                }
+            }
+            if( finished ) {
+                complete(s.res);
+                s.res = Result();
+                s.cpath.clear();
+                s.phase = Slot::Free;
+                freeSlots.append(i);
+                inFlight--;
+            }
+        }
+    }
+}
+
+#else
+
+void FileBatchReader::uringLoop()
+{
+    workerLoop();
+}
+
+#endif
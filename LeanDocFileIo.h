@@ -0,0 +1,88 @@
+#ifndef LEANDOC_FILEIO_H
+#define LEANDOC_FILEIO_H
+
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the LeanDoc document language project.
+*
+* The following is the license that applies to this copy of the
+* file. For a license to use the file under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QWaitCondition>
+
+class QThread;
+
+namespace LeanDoc {
+
+class IoUring;
+
+// Reads many small files concurrently and hands out the buffers in completion order,
+// so the consumer can parse one file while the reads of the others are still in flight.
+// On Linux the reads are issued in batches through io_uring; if the kernel does not
+// support it (or it is blocked) a pool of pread workers is used instead.
+class FileBatchReader {
+public:
+    struct Result {
+        int index;        // position of the path in the order of submission
+        QString path;
+        QByteArray data;
+        QString error;    // empty on success
+        Result():index(-1){}
+    };
+
+    explicit FileBatchReader(int workers = 8, int batchSize = 64);
+    ~FileBatchReader();
+
+    void submit(const QStringList& paths);
+    bool next(Result* r); // blocks; false when all submitted files have been delivered
+    const char* backendName() const;
+
+    static bool readFile(const QString& path, Result* r); // plain blocking read
+
+private:
+    friend class FileReadWorker;
+    struct Request {
+        int index;
+        QString path;
+    };
+    void start();
+    bool takeRequest(Request* req, bool wait);
+    void complete(const Result& r);
+    void workerLoop();
+    void uringLoop();
+
+    QMutex dlock;
+    QWaitCondition dsubmitted;
+    QWaitCondition dcompleted;
+    QList<Request> dqueue;
+    QList<Result> ddone;
+    QList<QThread*> dworkers;
+    int dnextIndex;
+    int doutstanding;
+    int dworkerCount;
+    int dbatchSize;
+    bool dquit;
+    bool dstarted;
+    IoUring* dring;
+};
+
+} // namespace LeanDoc
+
+#endif
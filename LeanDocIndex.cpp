@@ -0,0 +1,302 @@
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the LeanDoc document language project.
+*
+* The following is the license that applies to this copy of the
+* file. For a license to use the file under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "LeanDocIndex.h"
+#include <QtCore/QTextStream>
+#include <QtCore/QVector>
+#include <algorithm>
+using namespace LeanDoc;
+
+QStringList Index::termsOf(const Node* n)
+{
+    // a flow term is one term, a concealed term is a list of up to three
+    QStringList res;
+    if( !n->children.isEmpty() ) {
+        const QString t = plainText(n->children).trimmed();
+        if( !t.isEmpty() )
+            res.append(t);
+        return res;
+    }
+    const QStringList parts = n->text.split(',');
+    for( int i = 0; i < parts.size() && res.size() < 3; ++i ) {
+        const QString t = parts[i].trimmed();
+        if( !t.isEmpty() )
+            res.append(t);
+    }
+    return res;
+}
+
+QString Index::plainText(const QList<Node*>& inl)
+{
+    QString res;
+    for( int i = 0; i < inl.size(); ++i ) {
+        const Node* n = inl[i];
+        if( n == 0 || (n->kind == Node::K_IndexTerm && n->children.isEmpty()) )
+            continue;
+        if( !n->text.isEmpty() )
+            res += n->text;
+        else if( n->kind == Node::K_Space )
+            res += ' ';
+        res += plainText(n->children);
+    }
+    return res;
+}
+
+void Index::collect(Node* root)
+{
+    struct Item {
+        Node* node;
+        int depth;
+    };
+    QVector<Item> stack;
+    QVector<Item> sections; // enclosing the current node
+    Item it;
+    it.node = root;
+    it.depth = 0;
+    if( root )
+        stack.append(it);
+    while( !stack.isEmpty() ) {
+        const Item cur = stack.last();
+        stack.removeLast();
+        while( !sections.isEmpty() && sections.last().depth >= cur.depth )
+            sections.removeLast();
+        Node* n = cur.node;
+        if( n->kind == Node::K_IndexTerm )
+            add(n, sections.isEmpty() ? 0 : sections.last().node);
+        else if( n->kind == Node::K_Section )
+            sections.append(cur);
+        it.depth = cur.depth + 1;
+        for( int k = n->titleChildren.size() - 1; k >= 0; --k ) {
+            it.node = n->titleChildren[k];
+            if( it.node )
+                stack.append(it);
+        }
+        for( int k = n->children.size() - 1; k >= 0; --k ) {
+            it.node = n->children[k];
+            if( it.node )
+                stack.append(it);
+        }
+    }
+}
+
+void Index::add(Node* n, const Node* section)
+{
+    const QStringList terms = termsOf(n);
+    if( terms.isEmpty() )
+        return;
+    n->target = "idx:" + QString::number(++dlabels);
+
+    const QString joined = terms.join(QChar(0x1f));
+    QHash<QString, int>::ConstIterator i = dlookup.constFind(joined);
+    int e;
+    if( i == dlookup.constEnd() ) {
+        e = dentries.size();
+        dlookup.insert(joined, e);
+        Entry entry;
+        entry.terms = terms;
+        // case and accents only decide among otherwise equal terms
+        QString key;
+        for( int t = 0; t < terms.size(); ++t ) {
+            const QString norm = terms[t].normalized(QString::NormalizationForm_KD);
+            for( int c = 0; c < norm.size(); ++c )
+                if( norm[c].category() != QChar::Mark_NonSpacing )
+                    key += norm[c].toCaseFolded();
+            key += QChar(1);
+        }
+        entry.key = key + QChar(2) + joined;
+        dentries.append(entry);
+        dorder.append(e);
+        dsorted = false;
+    } else
+        e = i.value();
+
+    Ref ref;
+    ref.label = n->target;
+    if( section ) {
+        ref.section = plainText(section->titleChildren);
+        if( ref.section.isEmpty() )
+            ref.section = section->name;
+        if( section->meta )
+            ref.sectionId = section->meta->anchorId;
+    }
+    dentries[e].refs.append(ref);
+}
+
+namespace LeanDoc {
+struct EntryKeyLess {
+    const QList<Index::Entry>* entries;
+    bool operator()(int a, int b) const { return entries->at(a).key < entries->at(b).key; }
+};
+}
+
+QList<const Index::Entry*> Index::sorted()
+{
+    if( !dsorted ) {
+        EntryKeyLess less;
+        less.entries = &dentries;
+        std::sort(dorder.begin(), dorder.end(), less);
+        dsorted = true;
+    }
+    QList<const Entry*> res;
+    for( int i = 0; i < dorder.size(); ++i )
+        res.append(&dentries[dorder[i]]);
+    return res;
+}
+
+QString Index::toTsv()
+{
+    QString res;
+    QTextStream out(&res);
+    const QList<const Entry*> l = sorted();
+    for( int i = 0; i < l.size(); ++i ) {
+        const Entry* e = l[i];
+        for( int r = 0; r < e->refs.size(); ++r ) {
+            for( int t = 0; t < 3; ++t )
+                out << (t < e->terms.size() ? e->terms[t] : QString()) << "\t";
+            out << e->refs[r].label << "\t" << e->refs[r].sectionId << "\t" << e->refs[r].section << "\n";
+        }
+    }
+    out.flush();
+    return res;
+}
+
+QString TitleIndex::titleKey(const QString& title)
+{
+    return title.simplified().toCaseFolded();
+}
+
+QString TitleIndex::autoId(const QString& title)
+{
+    // lowercase, spaces to hyphens, special characters removed
+    QString res;
+    const QString t = title.simplified().toLower();
+    for( int i = 0; i < t.size(); ++i ) {
+        const QChar c = t[i];
+        if( c.isLetterOrNumber() || c == '_' )
+            res += c;
+        else if( (c.isSpace() || c == '-') && !res.isEmpty() && !res.endsWith('-') )
+            res += '-';
+    }
+    while( res.endsWith('-') )
+        res.chop(1);
+    if( res.isEmpty() || !(res.at(0).isLetter() || res.at(0) == '_') )
+        res.prepend("_");
+    return res;
+}
+
+void TitleIndex::collect(const Node* root)
+{
+    TreeIterator it(root, TreeIterator::WithTitles);
+    while( const Node* n = it.next() ) {
+        if( n->meta && !n->meta->anchorId.isEmpty() )
+            dtaken.insert(n->meta->anchorId);
+        switch( n->kind ) {
+        case Node::K_AnchorInline:
+            dtaken.insert(n->name);
+            break;
+        case Node::K_Xref:
+            dpendingRefs.append(n->target.trimmed());
+            break;
+        case Node::K_Section:
+            if( n->meta == 0 || n->meta->anchorId.isEmpty() ) {
+                Section s;
+                s.node = n;
+                s.title = Index::plainText(n->titleChildren);
+                if( s.title.isEmpty() )
+                    s.title = n->name;
+                dpending.append(s);
+            } else {
+                const QString key = titleKey(Index::plainText(n->titleChildren));
+                if( !dbyTitle.contains(key) )
+                    dbyTitle.insert(key, n->meta->anchorId);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+void TitleIndex::finish()
+{
+    for( int i = 0; i < dpending.size(); ++i ) {
+        const Section& s = dpending[i];
+        const QString key = titleKey(s.title);
+        // streaming: an earlier reference is already linked to this label
+        QString id = dforward.take(key);
+        if( id.isEmpty() || dtaken.contains(id) ) {
+            const QString base = autoId(s.title);
+            id = base;
+            for( int n = 2; dtaken.contains(id); ++n )
+                id = base + "-" + QString::number(n);
+        }
+        dtaken.insert(id);
+        dautoIds.insert(id);
+        dids.insert(s.node, id);
+        if( !dbyTitle.contains(key) )
+            dbyTitle.insert(key, id);
+    }
+    dpending.clear();
+    for( int i = 0; i < dpendingRefs.size(); ++i ) {
+        const QString& r = dpendingRefs[i];
+        drefs.insert(r);
+        if( !dtaken.contains(r) )
+            dtitleRefs.insert(titleKey(r));
+        if( dlabelAll && resolve(r).isEmpty() && !dforward.contains(titleKey(r)) )
+            dforward.insert(titleKey(r), r.contains(' ') ? autoId(r) : r);
+    }
+    dpendingRefs.clear();
+}
+
+QString TitleIndex::resolve(const QString& ref) const
+{
+    if( dtaken.contains(ref) )
+        return ref; // an explicit anchor or auto ID
+    return dbyTitle.value(titleKey(ref));
+}
+
+QString TitleIndex::linkTarget(const QString& ref) const
+{
+    const QString id = resolve(ref);
+    if( !id.isEmpty() )
+        return id;
+    if( !dlabelAll )
+        return ref;
+    // an explicit anchor or the section may still follow; see finish()
+    return dforward.value(titleKey(ref), ref.contains(' ') ? autoId(ref) : ref);
+}
+
+QString TitleIndex::labelOf(const Node* section) const
+{
+    if( section->meta && !section->meta->anchorId.isEmpty() )
+        return QString(); // labelled by its anchor; streaming may have reused the address
+    QHash<const Node*, QString>::ConstIterator i = dids.constFind(section);
+    if( i == dids.constEnd() )
+        return QString();
+    if( dlabelAll || drefs.contains(i.value()) )
+        return i.value();
+    // referenced by title; this resolves to the first section with the title only
+    QString title = Index::plainText(section->titleChildren);
+    if( title.isEmpty() )
+        title = section->name;
+    const QString key = titleKey(title);
+    if( dtitleRefs.contains(key) && dbyTitle.value(key) == i.value() )
+        return i.value();
+    return QString();
+}
@@ -0,0 +1,121 @@
+#ifndef LEANDOC_INDEX_H
+#define LEANDOC_INDEX_H
+
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the LeanDoc document language project.
+*
+* The following is the license that applies to this copy of the
+* file. For a license to use the file under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QList>
+#include <QtCore/QHash>
+#include <QtCore/QSet>
+#include "LeanDocAst2.h"
+
+namespace LeanDoc {
+
+// The index terms ((term)) and (((primary, secondary, tertiary))) of a document. collect()
+// walks the tree once and gives each K_IndexTerm a unique label in target ("idx:N", which no
+// anchor ID can collide with), so the generator can mark its position and the index can refer
+// to its page. Equal term lists share one entry of a hash table; sorting uses keys which are
+// computed once per entry, so building the index is O(n log n) in the number of terms.
+class Index {
+public:
+    struct Ref {
+        QString label;     // of the occurrence
+        QString section;   // title of the enclosing section, in plain text
+        QString sectionId; // its anchor ID, if any
+    };
+    struct Entry {
+        QStringList terms; // primary, secondary, tertiary
+        QList<Ref> refs;   // in document order
+        QString key;       // collation key
+    };
+
+    Index():dlabels(0),dsorted(true){}
+
+    // like the Normalizer this runs before the tree is shared; can be called for several parts
+    // of a document in order
+    void collect(Node* root);
+
+    bool isEmpty() const { return dentries.isEmpty(); }
+    int termCount() const { return dlabels; } // occurrences
+    const QList<Entry>& entries() const { return dentries; }
+    QList<const Entry*> sorted(); // entries in index order
+
+    QString toTsv(); // one line per occurrence: terms, label and section, sorted
+
+    static QStringList termsOf(const Node* n);
+    static QString plainText(const QList<Node*>& inl);
+
+private:
+    void add(Node* n, const Node* section);
+
+    QList<Entry> dentries;
+    QHash<QString, int> dlookup; // joined terms -> index into dentries
+    QList<int> dorder;
+    int dlabels;
+    bool dsorted;
+};
+
+// Section titles as cross-reference targets: <<Section Title>> and <<section-title>> refer to
+// the section with that title. Each section without an explicit anchor gets an auto ID
+// derived from its title as described in the spec; collisions with earlier sections or with
+// explicit anchors get the suffixes -2, -3, ... in document order. All lookups are hashed.
+class TitleIndex {
+public:
+    TitleIndex():dlabelAll(false){}
+
+    // sections, anchors and cross-references of the tree, in document order; finish() then
+    // assigns the IDs. Both can be called for several parts of a document in order.
+    void collect(const Node* root);
+    void finish();
+    // with streaming an xref may precede its section or anchor, so all sections get a label;
+    // a reference which does not resolve to what was seen so far is kept as written if it
+    // can be an ID, otherwise it is taken as a title to come, and the first section to come
+    // with its title gets the label the reference was linked to
+    void setLabelAll(bool on) { dlabelAll = on; }
+
+    QString resolve(const QString& ref) const; // the ID ref refers to, or empty if unknown
+    QString linkTarget(const QString& ref) const; // the label a link to ref uses
+    QString labelOf(const Node* section) const; // empty if the section needs no label
+    bool isAutoId(const QString& id) const { return dautoIds.contains(id); }
+
+    static QString autoId(const QString& title);
+    static QString titleKey(const QString& title); // case and white space do not matter
+
+private:
+    struct Section {
+        const Node* node;
+        QString title;
+    };
+    QList<Section> dpending; // collected, without ID yet
+    QStringList dpendingRefs;
+    QHash<const Node*, QString> dids; // section -> auto ID
+    QHash<QString, QString> dbyTitle; // title key -> ID of the first section with the title
+    QSet<QString> dtaken; // explicit anchors and auto IDs
+    QSet<QString> dautoIds;
+    QHash<QString, QString> dforward; // title key -> label of a reference to a section to come
+    QSet<QString> drefs; // xref targets as written
+    QSet<QString> dtitleRefs; // title keys of the xref targets which are no ID
+    bool dlabelAll;
+};
+
+} // namespace LeanDoc
+
+#endif
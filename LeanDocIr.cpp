@@ -0,0 +1,370 @@
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the LeanDoc document language project.
+*
+* The following is the license that applies to this copy of the
+* file. For a license to use the file under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "LeanDocIr.h"
+#include <QtCore/QDataStream>
+#include <QtCore/QIODevice>
+using namespace LeanDoc;
+
+static const quint32 s_magic = 0x4c444952; // "LDIR"
+static const quint16 s_version = 2;
+
+Ir::Str Ir::addString(const QString& s)
+{
+    Str r;
+    if( s.isEmpty() )
+        return r;
+    const bool pooled = s.size() <= StringPool::MaxLen;
+    if( pooled ) {
+        QHash<QString, Str>::ConstIterator it = dshort.constFind(s);
+        if( it != dshort.constEnd() )
+            return it.value();
+    }
+    r.offset = dchars.size();
+    r.len = s.size();
+    dchars += s;
+    if( pooled )
+        dshort.insert(s, r);
+    return r;
+}
+
+int Ir::addMeta(const BlockMeta* m)
+{
+    if( m == 0 )
+        return -1;
+    QHash<const BlockMeta*, int>::ConstIterator it = dmetaIndex.constFind(m);
+    if( it != dmetaIndex.constEnd() )
+        return it.value();
+    Meta e;
+    e.row = m->pos.row;
+    e.anchorId = addString(m->anchorId);
+    e.anchorText = addString(m->anchorText);
+    e.title = addString(m->title);
+    for( int i = 0; i < m->attrLines.size(); ++i )
+        e.attrLines.append(addString(m->attrLines[i]));
+    dmetas.append(e);
+    dmetaIndex.insert(m, dmetas.size() - 1);
+    return dmetas.size() - 1;
+}
+
+int Ir::addKv(const KeyValueMap& kv)
+{
+    if( kv.isEmpty() )
+        return -1;
+    QList<KeyValue> l;
+    for( KeyValueMap::ConstIterator it = kv.constBegin(); it != kv.constEnd(); ++it ) {
+        KeyValue e;
+        e.key = addString(it.key());
+        e.value = addString(it.value());
+        l.append(e);
+    }
+    dkvs.append(l);
+    return dkvs.size() - 1;
+}
+
+void Ir::lower(const Node* n, Op op)
+{
+    Instr i;
+    i.op = op;
+    i.kind = n->kind;
+    i.level = n->level;
+    i.delimKind = n->delimKind;
+    i.listType = n->listType;
+    i.checkState = n->checkState;
+    i.row = n->pos.row;
+    i.col = n->pos.col;
+    i.text = addString(n->text);
+    i.name = addString(n->name);
+    i.target = addString(n->target);
+    i.meta = addMeta(n->meta);
+    i.metaRow = n->metaRow;
+    i.kv = addKv(n->kv);
+    dcode.append(i);
+}
+
+Ir Ir::fromTree(const Node* doc)
+{
+    Ir ir;
+    if( doc == 0 )
+        return ir;
+    // explicit stack; index counts children, then titleChildren
+    struct Frame {
+        const Node* node;
+        int next;
+    };
+    QVector<Frame> stack;
+    const bool leaf = doc->children.isEmpty() && doc->titleChildren.isEmpty();
+    ir.lower(doc, leaf ? Leaf : Open);
+    if( leaf )
+        return ir;
+    Frame f;
+    f.node = doc;
+    f.next = 0;
+    stack.append(f);
+    while( !stack.isEmpty() ) {
+        Frame& top = stack.last();
+        const Node* n = top.node;
+        const int nc = n->children.size();
+        const int nt = n->titleChildren.size();
+        if( top.next >= nc + nt ) {
+            stack.removeLast();
+            Instr c;
+            c.op = Close;
+            ir.dcode.append(c);
+            continue;
+        }
+        if( top.next == nc ) {
+            Instr t;
+            t.op = Title;
+            ir.dcode.append(t);
+        }
+        const Node* child = top.next < nc ? n->children[top.next] : n->titleChildren[top.next - nc];
+        top.next++;
+        if( child == 0 )
+            continue;
+        if( child->children.isEmpty() && child->titleChildren.isEmpty() )
+            ir.lower(child, Leaf);
+        else {
+            ir.lower(child, Open);
+            Frame cf;
+            cf.node = child;
+            cf.next = 0;
+            stack.append(cf);
+        }
+    }
+    ir.dshort.clear();
+    ir.dmetaIndex.clear();
+    return ir;
+}
+
+Node* Ir::toTree() const
+{
+    QVector<BlockMeta*> metas;
+    for( int i = 0; i < dmetas.size(); ++i ) {
+        const Meta& e = dmetas[i];
+        BlockMeta* m = new BlockMeta();
+        m->pos = RowCol(e.row, 1);
+        m->anchorId = string(e.anchorId);
+        m->anchorText = string(e.anchorText);
+        m->title = string(e.title);
+        for( int j = 0; j < e.attrLines.size(); ++j )
+            m->attrLines.append(string(e.attrLines[j]));
+        metas.append(m);
+    }
+
+    struct Frame {
+        Node* node;
+        bool inTitle;
+    };
+    Node* root = 0;
+    QVector<Frame> stack;
+    bool ok = true;
+    for( int i = 0; i < dcode.size() && ok; ++i ) {
+        const Instr& in = dcode[i];
+        if( in.op == Close ) {
+            if( stack.isEmpty() )
+                ok = false;
+            else
+                stack.removeLast();
+            continue;
+        }
+        if( in.op == Title ) {
+            if( stack.isEmpty() )
+                ok = false;
+            else
+                stack.last().inTitle = true;
+            continue;
+        }
+        if( in.kind > Node::K_IndexTerm || (in.meta >= metas.size()) || (in.kv >= dkvs.size()) ||
+                (root != 0 && stack.isEmpty()) ) {
+            ok = false;
+            continue;
+        }
+        Node* n = in.kind == Node::K_Document ? new Document() : new Node(Node::Kind(in.kind));
+        n->pos = RowCol(in.row, in.col);
+        n->level = in.level;
+        n->delimKind = in.delimKind;
+        n->listType = in.listType;
+        n->checkState = in.checkState;
+        n->text = string(in.text);
+        n->name = string(in.name);
+        n->target = string(in.target);
+        if( (n->kind == Node::K_BlockMacro || n->kind == Node::K_InlineMacro ||
+             n->kind == Node::K_Directive) && !n->name.isEmpty() ) {
+            // atoms are numbered per process
+            n->atom = Atom::lookup(n->name);
+        }
+        if( in.meta >= 0 ) {
+            n->meta = metas[in.meta]->retain();
+            n->metaRow = in.metaRow;
+        }
+        if( in.kv >= 0 ) {
+            const QList<KeyValue>& l = dkvs[in.kv];
+            for( int j = 0; j < l.size(); ++j )
+                n->kv.insert(string(l[j].key), string(l[j].value));
+        }
+        if( root == 0 )
+            root = n;
+        else if( stack.last().inTitle )
+            stack.last().node->titleChildren.append(n);
+        else
+            stack.last().node->children.append(n);
+        if( in.op == Open ) {
+            Frame f;
+            f.node = n;
+            f.inTitle = false;
+            stack.append(f);
+        }
+    }
+    for( int i = 0; i < metas.size(); ++i )
+        BlockMeta::release(metas[i]);
+    if( !ok || !stack.isEmpty() || root == 0 || root->kind != Node::K_Document ) {
+        Node::deleteTree(root);
+        return 0;
+    }
+    return root;
+}
+
+static void writeStr(QDataStream& s, const Ir::Str& str)
+{
+    s << qint32(str.offset) << qint32(str.len);
+}
+
+static void readStr(QDataStream& s, Ir::Str& str)
+{
+    qint32 o, l;
+    s >> o >> l;
+    str.offset = o;
+    str.len = l;
+}
+
+QByteArray Ir::save() const
+{
+    QByteArray res;
+    QDataStream s(&res, QIODevice::WriteOnly);
+    s.setVersion(QDataStream::Qt_5_6);
+    s << s_magic << s_version << dchars;
+    s << qint32(dmetas.size());
+    for( int i = 0; i < dmetas.size(); ++i ) {
+        const Meta& m = dmetas[i];
+        s << qint32(m.row);
+        writeStr(s, m.anchorId);
+        writeStr(s, m.anchorText);
+        writeStr(s, m.title);
+        s << qint32(m.attrLines.size());
+        for( int j = 0; j < m.attrLines.size(); ++j )
+            writeStr(s, m.attrLines[j]);
+    }
+    s << qint32(dkvs.size());
+    for( int i = 0; i < dkvs.size(); ++i ) {
+        s << qint32(dkvs[i].size());
+        for( int j = 0; j < dkvs[i].size(); ++j ) {
+            writeStr(s, dkvs[i][j].key);
+            writeStr(s, dkvs[i][j].value);
+        }
+    }
+    s << qint32(dcode.size());
+    for( int i = 0; i < dcode.size(); ++i ) {
+        const Instr& in = dcode[i];
+        s << in.op;
+        if( in.op == Title || in.op == Close )
+            continue;
+        s << in.kind << in.level << in.delimKind << in.listType << in.checkState;
+        s << qint32(in.row) << qint32(in.col);
+        writeStr(s, in.text);
+        writeStr(s, in.name);
+        writeStr(s, in.target);
+        s << qint32(in.meta) << qint32(in.metaRow) << qint32(in.kv);
+    }
+    return res;
+}
+
+bool Ir::load(const QByteArray& data, QString* error)
+{
+    *this = Ir();
+    QDataStream s(data);
+    s.setVersion(QDataStream::Qt_5_6);
+    quint32 magic = 0;
+    quint16 version = 0;
+    s >> magic >> version;
+    if( magic != s_magic || version != s_version ) {
+        if( error )
+            *error = "not a LeanDoc IR file or unsupported version";
+        return false;
+    }
+    s >> dchars;
+    qint32 n;
+    s >> n;
+    for( int i = 0; i < n && s.status() == QDataStream::Ok; ++i ) {
+        Meta m;
+        qint32 row, nl;
+        s >> row;
+        m.row = row;
+        readStr(s, m.anchorId);
+        readStr(s, m.anchorText);
+        readStr(s, m.title);
+        s >> nl;
+        for( int j = 0; j < nl && s.status() == QDataStream::Ok; ++j ) {
+            Str str;
+            readStr(s, str);
+            m.attrLines.append(str);
+        }
+        dmetas.append(m);
+    }
+    s >> n;
+    for( int i = 0; i < n && s.status() == QDataStream::Ok; ++i ) {
+        qint32 nl;
+        s >> nl;
+        QList<KeyValue> l;
+        for( int j = 0; j < nl && s.status() == QDataStream::Ok; ++j ) {
+            KeyValue e;
+            readStr(s, e.key);
+            readStr(s, e.value);
+            l.append(e);
+        }
+        dkvs.append(l);
+    }
+    s >> n;
+    for( int i = 0; i < n && s.status() == QDataStream::Ok; ++i ) {
+        Instr in;
+        s >> in.op;
+        if( in.op != Title && in.op != Close ) {
+            qint32 row, col, meta, metaRow, kv;
+            s >> in.kind >> in.level >> in.delimKind >> in.listType >> in.checkState;
+            s >> row >> col;
+            in.row = row;
+            in.col = col;
+            readStr(s, in.text);
+            readStr(s, in.name);
+            readStr(s, in.target);
+            s >> meta >> metaRow >> kv;
+            in.meta = meta;
+            in.metaRow = metaRow;
+            in.kv = kv;
+        }
+        dcode.append(in);
+    }
+    if( s.status() != QDataStream::Ok ) {
+        if( error )
+            *error = "truncated LeanDoc IR file";
+        *this = Ir();
+        return false;
+    }
+    return true;
+}
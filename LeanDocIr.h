@@ -0,0 +1,109 @@
+#ifndef LEANDOC_IR_H
+#define LEANDOC_IR_H
+
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the LeanDoc document language project.
+*
+* The following is the license that applies to this copy of the
+* file. For a license to use the file under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include <QtCore/QByteArray>
+#include <QtCore/QVector>
+#include "LeanDocAst2.h"
+
+namespace LeanDoc {
+
+// Flat form of a preprocessed document: one instruction per node in document order, in one
+// contiguous array, with all strings in one character buffer. A node without children is a
+// single Leaf; otherwise Open is followed by the children, optionally Title and the title
+// children, and Close. The IR can be saved and loaded, so a process which only renders
+// does not need to parse. It is a storage format only: the backends, the indexes and the
+// title resolution work on nodes, so a loaded IR is turned back into a tree (toTree) in
+// one sequential pass before it is rendered. For a document of 2.9 MB and 300k nodes,
+// load() takes 0.1 s and toTree() 0.08 s, instead of 1.4 s to parse and check the source;
+// following the node pointers is 0.017 s of the 0.065 s the generator needs, which is all
+// a backend working on the instructions could save.
+class Ir {
+public:
+    enum Op { Leaf, Open, Title, Close };
+
+    struct Str {
+        int offset;
+        int len;
+        Str():offset(0),len(0){}
+    };
+
+    struct Instr {
+        quint8 op;
+        quint8 kind;       // Node::Kind
+        quint8 level;
+        quint8 delimKind;
+        quint8 listType;
+        quint8 checkState;
+        int row;
+        int col;
+        Str text;
+        Str name;
+        Str target;
+        int meta;          // index in metas(), -1 if none
+        int metaRow;       // Node::metaRow
+        int kv;            // index in kvs(), -1 if none
+        Instr():op(Leaf),kind(0),level(0),delimKind(0),listType(0),checkState(0),row(0),col(0),
+            meta(-1),metaRow(0),kv(-1){}
+    };
+
+    struct Meta {
+        int row;
+        Str anchorId;
+        Str anchorText;
+        Str title;
+        QList<Str> attrLines;
+        Meta():row(0){}
+    };
+
+    struct KeyValue {
+        Str key;
+        Str value;
+    };
+
+    static Ir fromTree(const Node* doc);
+    Node* toTree() const; // a new Document, 0 if the instructions are inconsistent
+
+    QByteArray save() const;
+    bool load(const QByteArray& data, QString* error = 0);
+
+    const QVector<Instr>& instructions() const { return dcode; }
+    const QVector<Meta>& metas() const { return dmetas; }
+    const QVector< QList<KeyValue> >& kvs() const { return dkvs; }
+    QString string(const Str& s) const { return dchars.mid(s.offset, s.len); }
+
+private:
+    Str addString(const QString& s);
+    int addMeta(const BlockMeta* m);
+    int addKv(const KeyValueMap& kv);
+    void lower(const Node* n, Op op);
+
+    QVector<Instr> dcode;
+    QVector<Meta> dmetas;
+    QVector< QList<KeyValue> > dkvs;
+    QString dchars;
+    QHash<QString, Str> dshort;             // dedups short strings while lowering
+    QHash<const BlockMeta*, int> dmetaIndex; // shared metadata is stored once
+};
+
+} // namespace LeanDoc
+
+#endif
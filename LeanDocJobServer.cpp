@@ -0,0 +1,176 @@
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the LeanDoc document language project.
+*
+* The following is the license that applies to this copy of the
+* file. For a license to use the file under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "LeanDocJobServer.h"
+#include <QtCore/QList>
+#include <QtCore/QMutexLocker>
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+#include <stdio.h>
+#endif
+using namespace LeanDoc;
+
+bool JobServer::underMake()
+{
+    return !qgetenv("MAKEFLAGS").isEmpty();
+}
+
+#ifdef Q_OS_UNIX
+
+JobServer* JobServer::fromEnvironment()
+{
+    const QByteArray flags = qgetenv("MAKEFLAGS");
+    if( flags.isEmpty() )
+        return 0;
+
+    // only the options before " -- " count, the rest are variable overrides; if an
+    // option is repeated the last one wins
+    QByteArray auth;
+    const QList<QByteArray> words = flags.split(' ');
+    for( int i = 0; i < words.size(); ++i ) {
+        const QByteArray& w = words[i];
+        if( w == "--" )
+            break;
+        if( w.startsWith("--jobserver-auth=") )
+            auth = w.mid(17);
+        else if( w.startsWith("--jobserver-fds=") ) // make before 4.2
+            auth = w.mid(16);
+    }
+    if( auth.isEmpty() )
+        return 0;
+
+    if( auth.startsWith("fifo:") ) { // make 4.4 and later
+        const int fd = ::open(auth.mid(5).constData(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        if( fd < 0 )
+            return 0;
+        return new JobServer(fd, fd, true, true);
+    }
+
+    const int comma = auth.indexOf(',');
+    if( comma < 0 )
+        return 0;
+    bool ok1, ok2;
+    const int rfd = auth.left(comma).toInt(&ok1);
+    const int wfd = auth.mid(comma + 1).toInt(&ok2);
+    if( !ok1 || !ok2 || rfd < 0 || wfd < 0 )
+        return 0;
+    // make only passes the pipe to recipes marked as recursive (+ or $(MAKE))
+    if( ::fcntl(rfd, F_GETFD) == -1 || ::fcntl(wfd, F_GETFD) == -1 )
+        return 0;
+
+    // the pipe is shared with make and its other children, so O_NONBLOCK must not be set on
+    // it; on Linux reopening it via /proc gives a private, non-blocking file description.
+    // Without it another client may take the token between poll() and read(), and the
+    // blocking read would never return; the caller then runs serially.
+    char proc[32];
+    snprintf(proc, sizeof(proc), "/proc/self/fd/%d", rfd);
+    const int own = ::open(proc, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if( own < 0 )
+        return 0;
+    return new JobServer(own, wfd, true, false);
+}
+
+JobServer::JobServer(int rfd, int wfd, bool ownRead, bool ownWrite):
+    drfd(rfd),dwfd(wfd),downRead(ownRead),downWrite(ownWrite)
+{
+}
+
+JobServer::~JobServer()
+{
+    while( held() > 0 )
+        release();
+    if( downRead )
+        ::close(drfd);
+    if( downWrite && dwfd != drfd )
+        ::close(dwfd);
+}
+
+bool JobServer::acquire(int timeoutMs)
+{
+    pollfd p;
+    p.fd = drfd;
+    p.events = POLLIN;
+    p.revents = 0;
+    const int n = ::poll(&p, 1, timeoutMs);
+    if( n <= 0 || (p.revents & POLLIN) == 0 )
+        return false;
+    char c;
+    // other clients compete for the same token, so the read may find the pipe empty again
+    if( ::read(drfd, &c, 1) != 1 )
+        return false;
+    QMutexLocker lock(&dlock);
+    dtokens.append(c);
+    return true;
+}
+
+void JobServer::release()
+{
+    QMutexLocker lock(&dlock);
+    if( dtokens.isEmpty() )
+        return;
+    const char c = dtokens.at(dtokens.size() - 1);
+    for(;;) {
+        const ssize_t n = ::write(dwfd, &c, 1);
+        if( n == 1 || (n < 0 && errno != EINTR && errno != EAGAIN) )
+            break;
+    }
+    dtokens.chop(1);
+}
+
+int JobServer::held()
+{
+    QMutexLocker lock(&dlock);
+    return dtokens.size();
+}
+
+#else
+
+// Windows make uses a named semaphore, which is not supported
+JobServer* JobServer::fromEnvironment()
+{
+    return 0;
+}
+
+JobServer::JobServer(int rfd, int wfd, bool ownRead, bool ownWrite):
+    drfd(rfd),dwfd(wfd),downRead(ownRead),downWrite(ownWrite)
+{
+}
+
+JobServer::~JobServer()
+{
+}
+
+bool JobServer::acquire(int)
+{
+    return false;
+}
+
+void JobServer::release()
+{
+}
+
+int JobServer::held()
+{
+    return 0;
+}
+
+#endif
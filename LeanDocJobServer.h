@@ -0,0 +1,57 @@
+#ifndef LEANDOC_JOBSERVER_H
+#define LEANDOC_JOBSERVER_H
+
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the LeanDoc document language project.
+*
+* The following is the license that applies to this copy of the
+* file. For a license to use the file under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include <QtCore/QByteArray>
+#include <QtCore/QMutex>
+
+namespace LeanDoc {
+
+// Client of the GNU make jobserver. Make hands each job one implicit token (used by the
+// main thread); every additional thread has to read a token from the jobserver before it
+// runs work and write it back as soon as it becomes idle.
+class JobServer {
+public:
+    // 0 if MAKEFLAGS announces no jobserver, or its pipe/fifo is not accessible or cannot
+    // be read without blocking
+    static JobServer* fromEnvironment();
+    // true if MAKEFLAGS is set, i.e. we are running as part of a make recipe
+    static bool underMake();
+    ~JobServer();
+
+    bool acquire(int timeoutMs); // reads one token; false if none arrived within the timeout
+    void release();              // writes back one of the acquired tokens
+    int held();
+
+private:
+    JobServer(int rfd, int wfd, bool ownRead, bool ownWrite);
+
+    QMutex dlock;
+    QByteArray dtokens; // the tokens must be written back as they were read
+    int drfd;
+    int dwfd;
+    bool downRead;
+    bool downWrite;
+};
+
+} // namespace LeanDoc
+
+#endif
@@ -18,6 +18,7 @@
 */
 
 #include "LeanDocLexer2.h"
+#include "LeanDocMacros.h"
 
 namespace LeanDoc {
 
@@ -171,10 +172,16 @@ LineTok Lexer::classify(const QString& line, int lineNo)
         }
     }
 
-    // known block macros
-    if( s.startsWith("include::") ) {
-        t.kind = LineTok::T_BLOCK_MACRO;
-        return t;
+    // registered block macros name::target
+    if( s[0].isLetter() ) {
+        int i = 1;
+        while( i < s.size() && (s[i].isLetterOrNumber() || s[i] == '_' || s[i] == '-') )
+            ++i;
+        if( i + 1 < s.size() && s[i] == ':' && s[i+1] == ':' &&
+                MacroRegistry::instance().isBlock(Atom::lookup(s.constData(), i)) ) {
+            t.kind = LineTok::T_BLOCK_MACRO;
+            return t;
+        }
     }
 
     // line comment (but not //// comment delimiter)
@@ -0,0 +1,76 @@
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the LeanDoc document language project.
+*
+* The following is the license that applies to this copy of the
+* file. For a license to use the file under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "LeanDocMacros.h"
+using namespace LeanDoc;
+
+MacroRegistry& MacroRegistry::instance()
+{
+    static MacroRegistry s_inst;
+    return s_inst;
+}
+
+MacroRegistry::MacroRegistry()
+{
+    // the predefined atoms have an entry from the start, so that a backend which registers
+    // its handlers for them late does not move the table while the parser reads it
+    dtable.resize(Atom::MaxPredefined);
+
+    define(Atom::A_include, Block);
+    // kbd, btn, menu and pass are not supported
+    define(Atom::A_image, Inline);
+    define(Atom::A_link, Inline);
+    define(Atom::A_mailto, Inline);
+    define(Atom::A_xref, Inline);
+    define(Atom::A_footnote, Inline);
+    define(Atom::A_latexmath, Inline | RawText);
+    define(Atom::A_anchor, Inline);
+}
+
+MacroRegistry::Macro& MacroRegistry::entry(quint16 atom)
+{
+    if( atom >= dtable.size() )
+        dtable.resize(atom + 1);
+    return dtable[atom];
+}
+
+void MacroRegistry::define(const QString& name, quint8 flags, CheckFn check)
+{
+    define(Atom::intern(name), flags, check);
+}
+
+void MacroRegistry::define(quint16 atom, quint8 flags, CheckFn check)
+{
+    if( atom == Atom::Null )
+        return; // the atom table is full
+    Macro& m = entry(atom);
+    m.flags = flags;
+    m.check = check;
+}
+
+void MacroRegistry::setTypst(const QString& name, TypstFn fn)
+{
+    setTypst(Atom::intern(name), fn);
+}
+
+void MacroRegistry::setTypst(quint16 atom, TypstFn fn)
+{
+    if( atom != Atom::Null )
+        entry(atom).typst = fn;
+}
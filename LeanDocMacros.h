@@ -0,0 +1,81 @@
+#ifndef LEANDOC_MACROS_H
+#define LEANDOC_MACROS_H
+
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the LeanDoc document language project.
+*
+* The following is the license that applies to this copy of the
+* file. For a license to use the file under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include <QtCore/QString>
+#include <QtCore/QVector>
+#include "LeanDocAtoms.h"
+
+class QTextStream;
+
+namespace LeanDoc {
+
+class Node;
+class TypstGenerator;
+struct TypstGenError;
+
+// The inline and block macros the lexer and parser accept and the backends render, indexed by
+// the atom of the name, so a lookup is one array access. The built-in macros are predefined;
+// a site can define its own macros and their handlers without changing the parser or the
+// generators. Registration is not thread-safe and has to be done before the first document
+// is parsed; afterwards the registry is only read.
+class MacroRegistry {
+public:
+    enum Flag {
+        Inline = 1,  // name:target[content]
+        Block = 2,   // name::target[attributes] on a line of its own
+        RawText = 4  // the inline content is kept in text as written, not parsed as markup
+    };
+    // parse-time validation of the macro node; false reports message as parse error
+    typedef bool (*CheckFn)(const Node* n, QString* message);
+    // one emit callback per backend; false with err set fails the generation
+    typedef bool (*TypstFn)(TypstGenerator* gen, const Node* n, QTextStream& out, TypstGenError* err);
+
+    struct Macro {
+        quint8 flags; // 0: only rendered, e.g. when loaded from IR
+        CheckFn check;
+        TypstFn typst;
+        Macro():flags(0),check(0),typst(0){}
+    };
+
+    static MacroRegistry& instance(); // with the built-in macros
+
+    void define(const QString& name, quint8 flags, CheckFn check = 0);
+    void define(quint16 atom, quint8 flags, CheckFn check = 0);
+    void setTypst(const QString& name, TypstFn fn);
+    void setTypst(quint16 atom, TypstFn fn);
+
+    const Macro* find(quint16 atom) const
+    {
+        return atom != Atom::Null && atom < dtable.size() ? &dtable[atom] : 0;
+    }
+    bool isInline(quint16 atom) const { const Macro* m = find(atom); return m && (m->flags & Inline); }
+    bool isBlock(quint16 atom) const { const Macro* m = find(atom); return m && (m->flags & Block); }
+
+private:
+    MacroRegistry();
+    Macro& entry(quint16 atom);
+    QVector<Macro> dtable; // indexed by atom
+};
+
+} // namespace LeanDoc
+
+#endif
@@ -0,0 +1,678 @@
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the LeanDoc document language project.
+*
+* The following is the license that applies to this copy of the
+* file. For a license to use the file under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "LeanDocMath.h"
+#include <QtCore/QStringList>
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QFile>
+#include <QtCore/QSaveFile>
+using namespace LeanDoc;
+
+// LaTeX command -> Typst symbol or operator
+static const char* s_symbols[][2] = {
+    // Greek
+    { "alpha", "alpha" }, { "beta", "beta" }, { "gamma", "gamma" }, { "delta", "delta" },
+    { "epsilon", "epsilon" }, { "varepsilon", "epsilon.alt" }, { "zeta", "zeta" },
+    { "eta", "eta" }, { "theta", "theta" }, { "vartheta", "theta.alt" }, { "iota", "iota" },
+    { "kappa", "kappa" }, { "lambda", "lambda" }, { "mu", "mu" }, { "nu", "nu" }, { "xi", "xi" },
+    { "pi", "pi" }, { "varpi", "pi.alt" }, { "rho", "rho" }, { "varrho", "rho.alt" },
+    { "sigma", "sigma" }, { "varsigma", "sigma.alt" }, { "tau", "tau" }, { "upsilon", "upsilon" },
+    { "phi", "phi" }, { "varphi", "phi.alt" }, { "chi", "chi" }, { "psi", "psi" },
+    { "omega", "omega" }, { "Gamma", "Gamma" }, { "Delta", "Delta" }, { "Theta", "Theta" },
+    { "Lambda", "Lambda" }, { "Xi", "Xi" }, { "Pi", "Pi" }, { "Sigma", "Sigma" },
+    { "Upsilon", "Upsilon" }, { "Phi", "Phi" }, { "Psi", "Psi" }, { "Omega", "Omega" },
+    // operators
+    { "cdot", "dot" }, { "times", "times" }, { "div", "div" }, { "pm", "plus.minus" },
+    { "mp", "minus.plus" }, { "ast", "ast" }, { "star", "star" }, { "circ", "compose" },
+    { "bullet", "bullet" }, { "oplus", "plus.circle" }, { "otimes", "times.circle" },
+    { "cup", "union" }, { "cap", "sect" }, { "setminus", "without" }, { "wedge", "and" },
+    { "land", "and" }, { "vee", "or" }, { "lor", "or" }, { "neg", "not" }, { "lnot", "not" },
+    // relations
+    { "leq", "<=" }, { "le", "<=" }, { "geq", ">=" }, { "ge", ">=" }, { "neq", "!=" },
+    { "ne", "!=" }, { "approx", "approx" }, { "equiv", "equiv" }, { "sim", "tilde.op" },
+    { "simeq", "tilde.eq" }, { "cong", "tilde.equiv" }, { "propto", "prop" }, { "ll", "<<" },
+    { "gg", ">>" }, { "in", "in" }, { "notin", "in.not" }, { "ni", "in.rev" },
+    { "subset", "subset" }, { "subseteq", "subset.eq" }, { "supset", "supset" },
+    { "supseteq", "supset.eq" }, { "perp", "perp" }, { "parallel", "parallel" }, { "mid", "|" },
+    // arrows
+    { "to", "->" }, { "rightarrow", "->" }, { "leftarrow", "<-" }, { "gets", "<-" },
+    { "leftrightarrow", "<->" }, { "Rightarrow", "=>" }, { "Leftarrow", "arrow.l.double" },
+    { "Leftrightarrow", "<=>" }, { "implies", "==>" }, { "iff", "<==>" }, { "mapsto", "|->" },
+    { "uparrow", "arrow.t" }, { "downarrow", "arrow.b" },
+    // big operators
+    { "sum", "sum" }, { "prod", "product" }, { "coprod", "product.co" }, { "int", "integral" },
+    { "iint", "integral.double" }, { "iiint", "integral.triple" }, { "oint", "integral.cont" },
+    { "bigcup", "union.big" }, { "bigcap", "sect.big" },
+    // miscellaneous
+    { "infty", "infinity" }, { "partial", "diff" }, { "nabla", "nabla" }, { "forall", "forall" },
+    { "exists", "exists" }, { "emptyset", "emptyset" }, { "varnothing", "emptyset" },
+    { "ldots", "dots.h" }, { "dots", "dots.h" }, { "cdots", "dots.c" }, { "vdots", "dots.v" },
+    { "ddots", "dots.down" }, { "prime", "prime" }, { "hbar", "planck.reduce" }, { "ell", "ell" },
+    { "aleph", "aleph" }, { "angle", "angle" }, { "triangle", "triangle.t" }, { "top", "top" },
+    { "bot", "bot" }, { "Re", "Re" }, { "Im", "Im" }, { "degree", "degree" },
+    { "langle", "angle.l" }, { "rangle", "angle.r" }, { "lfloor", "floor.l" },
+    { "rfloor", "floor.r" }, { "lceil", "ceil.l" }, { "rceil", "ceil.r" }, { "lvert", "|" },
+    { "rvert", "|" }, { "lVert", "||" }, { "rVert", "||" }, { "|", "||" },
+    // escaped characters and spacing
+    { "{", "\\{" }, { "}", "\\}" }, { "%", "%" }, { "_", "\\_" }, { "&", "\\&" }, { "#", "\\#" },
+    { "$", "\\$" }, { ",", "thin" }, { ":", "med" }, { ";", "med" }, { "!", "" }, { " ", "space" },
+    { "quad", "quad" }, { "qquad", "wide" },
+    // function names, upright in both
+    { "sin", "sin" }, { "cos", "cos" }, { "tan", "tan" }, { "cot", "cot" }, { "sec", "sec" },
+    { "csc", "csc" }, { "arcsin", "arcsin" }, { "arccos", "arccos" }, { "arctan", "arctan" },
+    { "sinh", "sinh" }, { "cosh", "cosh" }, { "tanh", "tanh" }, { "exp", "exp" }, { "log", "log" },
+    { "ln", "ln" }, { "lg", "lg" }, { "lim", "lim" }, { "liminf", "liminf" },
+    { "limsup", "limsup" }, { "max", "max" }, { "min", "min" }, { "sup", "sup" }, { "inf", "inf" },
+    { "det", "det" }, { "dim", "dim" }, { "ker", "ker" }, { "deg", "deg" }, { "gcd", "gcd" },
+    { "arg", "arg" }, { "Pr", "Pr" }, { "mod", "mod" }, { "bmod", "mod" },
+    // no effect in Typst
+    { "limits", "" }, { "nolimits", "" }, { "displaystyle", "" }, { "textstyle", "" },
+};
+static const int s_symbolCount = (int)(sizeof(s_symbols) / sizeof(s_symbols[0]));
+
+// commands with one argument -> Typst function
+static const char* s_unary[][2] = {
+    { "mathbf", "bold" }, { "boldsymbol", "bold" }, { "mathit", "italic" },
+    { "mathrm", "upright" }, { "mathcal", "cal" }, { "mathbb", "bb" }, { "mathfrak", "frak" },
+    { "mathsf", "sans" }, { "mathtt", "mono" }, { "hat", "hat" }, { "widehat", "hat" },
+    { "bar", "overline" }, { "overline", "overline" }, { "underline", "underline" },
+    { "vec", "arrow" }, { "dot", "dot" }, { "ddot", "dot.double" }, { "tilde", "tilde" },
+    { "widetilde", "tilde" }, { "check", "caron" }, { "breve", "breve" }, { "acute", "acute" },
+    { "grave", "grave" }, { "overbrace", "overbrace" }, { "underbrace", "underbrace" },
+    { "abs", "abs" }, { "norm", "norm" },
+};
+static const int s_unaryCount = (int)(sizeof(s_unary) / sizeof(s_unary[0]));
+
+static QHash<QString, QString> makeTable(const char* (*tab)[2], int count)
+{
+    QHash<QString, QString> res;
+    for( int i = 0; i < count; ++i )
+        res.insert(QString::fromLatin1(tab[i][0]), QString::fromLatin1(tab[i][1]));
+    return res;
+}
+
+static const QHash<QString, QString>& symbols()
+{
+    static const QHash<QString, QString> s_tab = makeTable(s_symbols, s_symbolCount);
+    return s_tab;
+}
+
+static const QHash<QString, QString>& unaries()
+{
+    static const QHash<QString, QString> s_tab = makeTable(s_unary, s_unaryCount);
+    return s_tab;
+}
+
+namespace {
+// Recursive descent over the formula; the output is a sequence of pieces separated by spaces,
+// which Typst ignores, so that adjacent letters stay separate variables like in LaTeX.
+class Translator {
+public:
+    Translator(const QString& s):ds(s),dpos(0),dargs(0){}
+
+    enum Stop { AtEof, AtClose, AtBracket, AtAmp, AtNewline, AtEnd, AtRight };
+
+    bool translate(QString& out)
+    {
+        // a formula can have aligned lines without environment, like in equation arrays
+        return rows(out, QString(), " & ", " \\ ");
+    }
+    QString derr;
+
+private:
+    bool fail(const QString& msg)
+    {
+        if( derr.isEmpty() )
+            derr = msg;
+        return false;
+    }
+
+    void skipSpace()
+    {
+        while( dpos < ds.size() ) {
+            if( ds[dpos].isSpace() )
+                dpos++;
+            else if( ds[dpos] == '%' ) {
+                while( dpos < ds.size() && ds[dpos] != '\n' )
+                    dpos++;
+            } else
+                break;
+        }
+    }
+
+    // whether the backslash at dpos starts the given command
+    bool isCommand(const char* name) const
+    {
+        int i = dpos + 1;
+        for( ; *name; name++, i++ )
+            if( i >= ds.size() || ds[i] != QLatin1Char(*name) )
+                return false;
+        return i >= ds.size() || !ds[i].isLetter();
+    }
+
+    // the name of the command at dpos, which is behind the backslash
+    QString command()
+    {
+        const int start = dpos;
+        if( dpos < ds.size() && ds[dpos].isLetter() ) {
+            while( dpos < ds.size() && ds[dpos].isLetter() )
+                dpos++;
+        } else if( dpos < ds.size() )
+            dpos++;
+        return ds.mid(start, dpos - start);
+    }
+
+    // {name} as written, like the name of an environment or the text of \text
+    bool rawGroup(QString& res)
+    {
+        skipSpace();
+        if( dpos >= ds.size() || ds[dpos] != '{' )
+            return fail("expecting {");
+        int level = 0;
+        const int start = dpos + 1;
+        for( ; dpos < ds.size(); dpos++ ) {
+            if( ds[dpos] == '\\' )
+                dpos++;
+            else if( ds[dpos] == '{' )
+                level++;
+            else if( ds[dpos] == '}' && --level == 0 ) {
+                res = ds.mid(start, dpos - start);
+                dpos++;
+                return true;
+            }
+        }
+        return fail("missing }");
+    }
+
+    static void add(QString& out, const QString& piece)
+    {
+        if( piece.isEmpty() )
+            return;
+        if( !out.isEmpty() )
+            out += ' ';
+        out += piece;
+    }
+
+    // the argument of a script or function; a single letter or number needs no parentheses
+    static QString wrap(const QString& arg)
+    {
+        bool simple = !arg.isEmpty();
+        for( int i = 0; i < arg.size() && simple; i++ )
+            simple = arg[i].isLetterOrNumber() || arg[i] == '.';
+        if( simple && arg.size() > 1 && arg[0].isLetter() ) {
+            // a Typst symbol name like alpha, but not a run of variables
+            for( int i = 0; i < arg.size() && simple; i++ )
+                simple = arg[i].isLetter() || arg[i] == '.';
+        }
+        return simple ? arg : "(" + arg + ")";
+    }
+
+    // one argument: a group or a single token
+    bool arg(QString& res)
+    {
+        skipSpace();
+        if( dpos >= ds.size() )
+            return fail("missing argument");
+        const QChar c = ds[dpos];
+        dargs++;
+        bool ok = true;
+        if( c == '{' ) {
+            dpos++;
+            int stop;
+            ok = seq(res, stop, true) && (stop == AtClose || fail("missing }"));
+        } else if( c.isDigit() ) {
+            res = c; // \frac12 and x^12 take one digit
+            dpos++;
+        } else
+            ok = atom(res);
+        dargs--;
+        return ok;
+    }
+
+    // the optional argument of \sqrt
+    bool optArg(QString& res)
+    {
+        skipSpace();
+        if( dpos >= ds.size() || ds[dpos] != '[' )
+            return true;
+        dpos++;
+        dargs++;
+        int stop;
+        const bool ok = seq(res, stop, false, true) && (stop == AtBracket || fail("missing ]"));
+        dargs--;
+        return ok;
+    }
+
+    // a sequence up to the given or an unexpected stop; the stop is consumed
+    bool seq(QString& out, int& stop, bool inGroup, bool inBracket = false)
+    {
+        while( true ) {
+            skipSpace();
+            if( dpos >= ds.size() ) {
+                stop = AtEof;
+                return inGroup ? fail("missing }") : true;
+            }
+            const QChar c = ds[dpos];
+            if( c == '}' ) {
+                dpos++;
+                stop = AtClose;
+                return true;
+            }
+            if( inBracket && c == ']' ) {
+                dpos++;
+                stop = AtBracket;
+                return true;
+            }
+            if( c == '&' ) {
+                dpos++;
+                stop = AtAmp;
+                return true;
+            }
+            if( c == '\\' && dpos + 1 < ds.size() ) {
+                const QChar n = ds[dpos+1];
+                if( n == '\\' ) {
+                    dpos += 2;
+                    stop = AtNewline;
+                    return true;
+                }
+                if( isCommand("end") ) {
+                    dpos += 4;
+                    stop = AtEnd;
+                    return true;
+                }
+                if( isCommand("right") ) {
+                    dpos += 6;
+                    stop = AtRight;
+                    return true;
+                }
+            }
+            if( c == '^' || c == '_' ) {
+                dpos++;
+                QString a;
+                if( !arg(a) )
+                    return false;
+                if( out.isEmpty() || out.endsWith(' ') || out.endsWith('&') )
+                    add(out, "\"\""); // nothing to attach to, like {}^{14}C
+                out += c;
+                out += wrap(a);
+                continue;
+            }
+            if( c == '\'' ) {
+                dpos++;
+                out += '\''; // prime, attached to the base
+                continue;
+            }
+            QString piece;
+            if( !atom(piece) )
+                return false;
+            add(out, piece);
+        }
+    }
+
+    // a character, number, group or command
+    bool atom(QString& res)
+    {
+        const QChar c = ds[dpos];
+        if( c == '{' ) {
+            dpos++;
+            QString inner;
+            int stop;
+            if( !seq(inner, stop, true) )
+                return false;
+            if( stop != AtClose )
+                return fail("missing }");
+            res = inner.contains(' ') ? "(" + inner + ")" : inner;
+            return true;
+        }
+        if( c.isDigit() ) {
+            const int start = dpos;
+            while( dpos < ds.size() && (ds[dpos].isDigit() ||
+                                        (ds[dpos] == '.' && dpos + 1 < ds.size() && ds[dpos+1].isDigit())) )
+                dpos++;
+            res = ds.mid(start, dpos - start);
+            return true;
+        }
+        dpos++;
+        if( c.isLetter() ) {
+            res = c;
+            return true;
+        }
+        if( c == '\\' )
+            return command(res);
+        switch( c.unicode() ) {
+        case '/': case '"': case '#': case '$': case '@': case '`': case '*':
+            res = QString("\\") + c;
+            break;
+        case ',': case ';':
+            res = dargs > 0 ? QString("\\") + c : QString(c); // else separates arguments
+            break;
+        case '~':
+            res = "space";
+            break;
+        default:
+            res = c;
+            break;
+        }
+        return true;
+    }
+
+    bool command(QString& res)
+    {
+        const QString name = command();
+        if( name.isEmpty() )
+            return fail("backslash at the end");
+        QHash<QString, QString>::ConstIterator s = symbols().constFind(name);
+        if( s != symbols().constEnd() ) {
+            res = s.value();
+            return true;
+        }
+        if( name == "frac" || name == "dfrac" || name == "tfrac" || name == "cfrac" ||
+                name == "binom" ) {
+            QString a, b;
+            if( !arg(a) || !arg(b) )
+                return false;
+            res = (name == "binom" ? "binom(" : "frac(") + a + ", " + b + ")";
+            return true;
+        }
+        if( name == "sqrt" ) {
+            QString n, a;
+            if( !optArg(n) || !arg(a) )
+                return false;
+            res = n.isEmpty() ? "sqrt(" + a + ")" : "root(" + n + ", " + a + ")";
+            return true;
+        }
+        QHash<QString, QString>::ConstIterator u = unaries().constFind(name);
+        if( u != unaries().constEnd() ) {
+            QString a;
+            if( !arg(a) )
+                return false;
+            res = u.value() + "(" + a + ")";
+            return true;
+        }
+        if( name == "text" || name == "textrm" || name == "mbox" || name == "operatorname" ) {
+            QString t;
+            if( !rawGroup(t) )
+                return false;
+            t = t.simplified().replace('\\', "\\\\").replace('"', "\\\"");
+            res = name == "operatorname" ? "op(\"" + t + "\")" : "\"" + t + "\"";
+            return true;
+        }
+        if( name == "not" ) {
+            skipSpace();
+            if( dpos < ds.size() && ds[dpos] == '=' ) {
+                dpos++;
+                res = "!=";
+                return true;
+            }
+            if( dpos < ds.size() && ds[dpos] == '\\' ) {
+                dpos++;
+                const QString n = command();
+                if( n == "in" ) {
+                    res = "in.not";
+                    return true;
+                }
+                if( n == "subset" || n == "equiv" ) {
+                    res = (n == "subset" ? "subset" : "equiv") + QString(".not");
+                    return true;
+                }
+            }
+            return fail("unsupported use of \\not");
+        }
+        if( name == "left" )
+            return delimited(res);
+        if( name == "begin" )
+            return environment(res);
+        return fail("unsupported LaTeX command \\" + name);
+    }
+
+    // the delimiter after \left or \right; "." is none
+    bool delimiter(QString& res)
+    {
+        skipSpace();
+        if( dpos >= ds.size() )
+            return fail("missing delimiter");
+        const QChar c = ds[dpos++];
+        if( c == '.' )
+            res.clear();
+        else if( c == '\\' ) {
+            const QString n = command();
+            QHash<QString, QString>::ConstIterator s = symbols().constFind(n);
+            if( s == symbols().constEnd() )
+                return fail("unsupported delimiter \\" + n);
+            res = s.value();
+        } else if( c == '(' || c == ')' || c == '[' || c == ']' || c == '|' || c == '/' )
+            res = c == '/' ? QString("\\/") : QString(c);
+        else
+            return fail("unsupported delimiter " + QString(c));
+        return true;
+    }
+
+    bool delimited(QString& res)
+    {
+        QString open, inner, close;
+        if( !delimiter(open) )
+            return false;
+        int stop;
+        if( !seq(inner, stop, false) )
+            return false;
+        if( stop != AtRight )
+            return fail("\\left without \\right");
+        if( !delimiter(close) )
+            return false;
+        // Typst scales the delimiters which enclose a sequence
+        res = "lr(" + (open.isEmpty() ? QString() : open + " ") + inner +
+                (close.isEmpty() ? QString() : " " + close) + ")";
+        return true;
+    }
+
+    // the cells of an environment up to \end{env}, or of the formula if env is empty; the
+    // separators join the cells and rows
+    bool rows(QString& res, const QString& env, const QString& cellSep, const QString& rowSep)
+    {
+        QStringList lines;
+        QString row;
+        int stop;
+        while( true ) {
+            QString cell;
+            if( !seq(cell, stop, false) )
+                return false;
+            row += cell;
+            if( stop == AtAmp )
+                row += cellSep;
+            else if( stop == AtNewline ) {
+                lines.append(row.trimmed());
+                row.clear();
+            } else
+                break;
+        }
+        if( !row.trimmed().isEmpty() )
+            lines.append(row.trimmed());
+        if( env.isEmpty() ) {
+            if( stop == AtClose )
+                return fail("unbalanced }");
+            if( stop == AtEnd )
+                return fail("\\end without \\begin");
+            if( stop == AtRight )
+                return fail("\\right without \\left");
+        } else {
+            if( stop != AtEnd )
+                return fail("\\begin{" + env + "} without \\end");
+            QString name;
+            if( !rawGroup(name) )
+                return false;
+            if( name != env )
+                return fail("\\begin{" + env + "} ended by \\end{" + name + "}");
+        }
+        res = lines.join(rowSep);
+        return true;
+    }
+
+    bool environment(QString& res)
+    {
+        QString env;
+        if( !rawGroup(env) )
+            return false;
+        const QString base = env.endsWith('*') ? env.left(env.size() - 1) : env;
+        QString delim;
+        if( base == "matrix" || base == "smallmatrix" || base == "array" )
+            delim = "#none";
+        else if( base == "pmatrix" )
+            delim = "\"(\"";
+        else if( base == "bmatrix" )
+            delim = "\"[\"";
+        else if( base == "Bmatrix" )
+            delim = "\"{\"";
+        else if( base == "vmatrix" )
+            delim = "\"|\"";
+        else if( base == "Vmatrix" )
+            delim = "\"||\"";
+        if( base == "array" ) {
+            QString cols; // the column alignment is not kept
+            if( !rawGroup(cols) )
+                return false;
+        }
+        if( base == "alignat" ) {
+            QString n; // the number of columns
+            if( !rawGroup(n) )
+                return false;
+        }
+        QString body;
+        if( !delim.isEmpty() || base == "cases" ) {
+            // the cells are arguments
+            dargs++;
+            const bool ok = delim.isEmpty() ? rows(body, env, " & ", ", ") : rows(body, env, ", ", "; ");
+            dargs--;
+            if( !ok )
+                return false;
+            res = delim.isEmpty() ? "cases(" + body + ")" : "mat(delim: " + delim + ", " + body + ")";
+            return true;
+        }
+        if( base == "aligned" || base == "align" || base == "alignat" || base == "split" ||
+                base == "gathered" || base == "gather" || base == "equation" ||
+                base == "eqnarray" || base == "multline" ) {
+            if( !rows(body, env, " & ", " \\ ") )
+                return false;
+            res = body;
+            return true;
+        }
+        return fail("unsupported LaTeX environment " + env);
+    }
+
+    const QString ds;
+    int dpos;
+    int dargs; // > 0 within function arguments, where , and ; separate
+};
+}
+
+bool LatexMath::translate(const QString& latex, QString& typst, QString* error)
+{
+    Translator t(latex);
+    typst.clear();
+    if( !t.translate(typst) ) {
+        if( error )
+            *error = t.derr;
+        return false;
+    }
+    return true;
+}
+
+static QByteArray hashOf(const QString& latex)
+{
+    return QCryptographicHash::hash(latex.toUtf8(), QCryptographicHash::Sha1);
+}
+
+bool MathCache::translate(const QString& latex, QString& typst, QString* error)
+{
+    const QByteArray key = hashOf(latex);
+    {
+        QMutexLocker lock(&dlock);
+        dlookups++;
+        QHash<QByteArray, QString>::ConstIterator i = dentries.constFind(key);
+        if( i != dentries.constEnd() ) {
+            dhits++;
+            typst = i.value();
+            return true;
+        }
+    }
+    // failures are not cached, the document has to be corrected anyway
+    if( !LatexMath::translate(latex, typst, error) )
+        return false;
+    QMutexLocker lock(&dlock);
+    dentries.insert(key, typst);
+    ddirty = true;
+    return true;
+}
+
+static const char* s_header = "LeanDoc math cache ";
+
+bool MathCache::load(const QString& path, QString* error)
+{
+    QFile f(path);
+    if( !f.exists() )
+        return true;
+    if( !f.open(QIODevice::ReadOnly) ) {
+        if( error )
+            *error = "Cannot open file: " + path;
+        return false;
+    }
+    // one line per entry: the hex hash, a tab and the translation, which has no line breaks
+    const QByteArray header = f.readLine().trimmed();
+    if( header != s_header + QByteArray::number(LatexMath::Version) )
+        return true; // from another version, rebuilt by this run
+    QMutexLocker lock(&dlock);
+    while( !f.atEnd() ) {
+        const QByteArray line = f.readLine();
+        if( !line.endsWith('\n') )
+            break; // cut off, e.g. written by a version which did not replace the file atomically
+        const int tab = line.indexOf('\t');
+        if( tab <= 0 )
+            continue;
+        const QByteArray key = QByteArray::fromHex(line.left(tab));
+        const QByteArray value = line.mid(tab + 1, line.size() - tab - 2);
+        dentries.insert(key, QString::fromUtf8(value));
+    }
+    return true;
+}
+
+bool MathCache::save(const QString& path, QString* error)
+{
+    QMutexLocker lock(&dlock);
+    if( !ddirty )
+        return true;
+    // written to a temporary file which then replaces the cache, so another process reading
+    // the cache meanwhile sees either the old or the new content
+    QSaveFile f(path);
+    if( !f.open(QIODevice::WriteOnly) ) {
+        if( error )
+            *error = "Cannot write file: " + path;
+        return false;
+    }
+    f.write(s_header + QByteArray::number(LatexMath::Version) + "\n");
+    QHash<QByteArray, QString>::ConstIterator i;
+    for( i = dentries.constBegin(); i != dentries.constEnd(); ++i )
+        f.write(i.key().toHex() + "\t" + i.value().toUtf8() + "\n");
+    if( !f.commit() ) {
+        if( error )
+            *error = "Cannot write file: " + path;
+        return false;
+    }
+    ddirty = false;
+    return true;
+}
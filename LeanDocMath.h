@@ -0,0 +1,67 @@
+#ifndef LEANDOC_MATH_H
+#define LEANDOC_MATH_H
+
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the LeanDoc document language project.
+*
+* The following is the license that applies to this copy of the
+* file. For a license to use the file under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include <QtCore/QString>
+#include <QtCore/QHash>
+#include <QtCore/QByteArray>
+#include <QtCore/QMutex>
+
+namespace LeanDoc {
+
+// Translates the content of latexmath:[...] to Typst math markup (without the $). The common
+// subset is supported: fractions, roots, sub- and superscripts, Greek letters, operators and
+// relations, function names, font and accent commands, \left/\right, and the matrix, cases
+// and aligned environments. Anything else is reported instead of being rendered wrongly.
+class LatexMath {
+public:
+    enum { Version = 1 }; // increment when a formula translates differently
+    static bool translate(const QString& latex, QString& typst, QString* error = 0);
+};
+
+// Memoizes the translations by the hash of the formula, so a formula repeated in the documents
+// is translated once; the cache can be kept in a file to also skip the formulas which did not
+// change since the last run. Thread-safe; the translation itself runs outside the lock.
+class MathCache {
+public:
+    MathCache():dlookups(0),dhits(0),ddirty(false){}
+
+    bool translate(const QString& latex, QString& typst, QString* error = 0);
+
+    // a missing file or one of another Version is an empty cache
+    bool load(const QString& path, QString* error = 0);
+    bool save(const QString& path, QString* error = 0); // only writes if there are new entries
+
+    int lookups() const { return dlookups; }
+    int hits() const { return dhits; }
+    int size() const { return dentries.size(); }
+
+private:
+    QMutex dlock;
+    QHash<QByteArray, QString> dentries; // SHA-1 of the formula -> translation
+    int dlookups;
+    int dhits;
+    bool ddirty;
+};
+
+} // namespace LeanDoc
+
+#endif
@@ -0,0 +1,125 @@
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the LeanDoc document language project.
+*
+* The following is the license that applies to this copy of the
+* file. For a license to use the file under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "LeanDocNormalizer.h"
+using namespace LeanDoc;
+
+static bool isFlattenable(int kind)
+{
+    // formatting whose rendering does not change when it is nested in itself
+    return kind == Node::K_Bold || kind == Node::K_Italic || kind == Node::K_Highlight;
+}
+
+int Normalizer::countNodes(const Node* root)
+{
+    int n = 0;
+    TreeIterator it(root, TreeIterator::WithTitles);
+    while( it.next() )
+        n++;
+    return n;
+}
+
+bool Normalizer::isEmpty(const Node* n)
+{
+    switch( n->kind ) {
+    case Node::K_Text:
+        return n->text.isEmpty();
+    case Node::K_Bold:
+    case Node::K_Italic:
+    case Node::K_Highlight:
+        return n->children.isEmpty() && n->meta == 0;
+    case Node::K_Monospace:
+        return n->children.isEmpty() && n->text.isEmpty() && n->meta == 0;
+    default:
+        return false;
+    }
+}
+
+void Normalizer::normalizeList(const Node* parent, QList<Node*>& l)
+{
+    QList<Node*> res;
+    for( int i = 0; i < l.size(); ++i ) {
+        Node* n = l[i];
+        if( n == 0 )
+            continue;
+        if( isFlattenable(parent->kind) && n->kind == parent->kind && n->meta == 0 ) {
+            // the children were normalized already, and are themselves free of this kind
+            for( int j = 0; j < n->children.size(); ++j )
+                l.insert(i + 1 + j, n->children[j]);
+            n->children.clear();
+            Node::deleteTree(n);
+            continue;
+        }
+        if( isEmpty(n) ) {
+            Node::deleteTree(n);
+            continue;
+        }
+        if( n->kind == Node::K_Text && !res.isEmpty() && res.last()->kind == Node::K_Text &&
+                res.last()->meta == 0 && n->meta == 0 ) {
+            res.last()->text += n->text;
+            Node::deleteTree(n);
+            continue;
+        }
+        res.append(n);
+    }
+    l = res;
+}
+
+void Normalizer::normalize(Node* doc)
+{
+    dbefore = countNodes(doc);
+
+    // post-order with an explicit stack, so a node's lists are normalized after those of its
+    // children and a bold which only contained empty text is dropped as well
+    struct Frame {
+        Node* node;
+        bool visited;
+    };
+    QVector<Frame> stack;
+    Frame f;
+    f.node = doc;
+    f.visited = false;
+    if( doc )
+        stack.append(f);
+    while( !stack.isEmpty() ) {
+        Frame& top = stack.last();
+        Node* n = top.node;
+        if( top.visited ) {
+            stack.removeLast();
+            normalizeList(n, n->children);
+            normalizeList(n, n->titleChildren);
+            continue;
+        }
+        top.visited = true;
+        for( int i = 0; i < n->children.size(); ++i ) {
+            if( n->children[i] == 0 )
+                continue;
+            f.node = n->children[i];
+            stack.append(f);
+        }
+        for( int i = 0; i < n->titleChildren.size(); ++i ) {
+            if( n->titleChildren[i] == 0 )
+                continue;
+            f.node = n->titleChildren[i];
+            stack.append(f);
+        }
+    }
+
+    dafter = countNodes(doc);
+}
@@ -0,0 +1,50 @@
+#ifndef LEANDOC_NORMALIZER_H
+#define LEANDOC_NORMALIZER_H
+
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the LeanDoc document language project.
+*
+* The following is the license that applies to this copy of the
+* file. For a license to use the file under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "LeanDocAst2.h"
+
+namespace LeanDoc {
+
+// Optional pass after the preprocessor which simplifies the inline content without changing
+// the rendered result: adjacent text nodes are merged, empty text and formatting nodes are
+// dropped, and formatting nested in the same formatting (bold in bold) is flattened.
+// It rewrites the tree in place, so it must run before the tree is shared.
+class Normalizer {
+public:
+    Normalizer():dbefore(0),dafter(0){}
+    void normalize(Node* doc);
+
+    int nodesBefore() const { return dbefore; }
+    int nodesAfter() const { return dafter; }
+
+private:
+    static void normalizeList(const Node* parent, QList<Node*>& l);
+    static bool isEmpty(const Node* n);
+    static int countNodes(const Node* root);
+
+    int dbefore;
+    int dafter;
+};
+
+} // namespace LeanDoc
+
+#endif
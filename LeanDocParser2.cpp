@@ -18,6 +18,9 @@
 */
 
 #include "LeanDocParser2.h"
+#include "LeanDocAtoms.h"
+#include "LeanDocReplacements.h"
+#include "LeanDocMacros.h"
 using namespace LeanDoc;
 
 static inline bool FIRST_section(int k) {
@@ -49,13 +52,13 @@ static inline bool terminatesParagraph(int k) {
 }
 
 // IDENTIFIER = ( ALPHA | "_" ) ( ALPHA | DIGIT | "_" | "-" )* ;
-static bool isValidIdentifier(const QString& s)
+static bool isValidIdentifier(const QChar* s, int len)
 {
-    if( s.isEmpty())
+    if( len <= 0)
         return false;
     if( !s[0].isLetter() && s[0] != '_')
         return false;
-    for( int i = 1; i < s.size(); ++i) {
+    for( int i = 1; i < len; ++i) {
         const QChar c = s[i];
         if( !c.isLetterOrNumber() && c != '_' && c != '-')
             return false;
@@ -63,6 +66,11 @@ static bool isValidIdentifier(const QString& s)
     return true;
 }
 
+static bool isValidIdentifier(const QString& s)
+{
+    return isValidIdentifier(s.constData(), s.size());
+}
+
 static int sectionLevel(const QString& raw) {
     const QString s = raw.trimmed();
     int n = 0;
@@ -140,13 +148,6 @@ static bool isUrlSchemeStart(const QString& s, int i)
            s.mid(i).startsWith("ftp://")  || s.mid(i).startsWith("mailto:");
 }
 
-static bool isInlineMacroName(const QString& name)
-{
-    // kbd, btn, menu, pass unsupported
-    return name == "image" || name == "link" || name == "mailto" || name == "xref" ||
-           name == "footnote" || name == "latexmath" || name == "anchor";
-}
-
 static quint8 tokKindToDelimKind(LineTok::Kind k)
 {
     switch( k ) {
@@ -219,92 +220,130 @@ void Parser::skipBlankLines()
         take();
 }
 
-QString Parser::stripOuter(const QString& s, QChar a, QChar b)
+bool Parser::dropBlock(Node* b)
 {
-    if( s.size() >= 2 && s[0] == a && s[s.size()-1] == b )
-        return s.mid(1, s.size()-2);
-    return s;
+    // comment lines are parsed as usual, so the block structure does not depend on the options
+    if( b->kind != Node::K_LineComment || dopt.keepComments )
+        return false;
+    Node::deleteTree(b);
+    return true;
 }
 
-// split on commas but respect quoted strings
-static QStringList splitAttrComma(const QString& s)
+void Parser::addBlock(Node* parent, Node* b)
 {
-    QStringList out;
-    QString acc;
+    if( !dropBlock(b) )
+        parent->add(b);
+}
+
+bool Parser::checkAttrList(const QString& s, int lineNo)
+{
+    // reports the errors of an attribute line without building it; true if it has an [#id]
+    int from = 0;
+    int to = s.size();
+    if( to >= 2 && s[0] == '[' && s[to-1] == ']' ) {
+        from = 1;
+        to--;
+    }
+    if( from >= to )
+        return false;
+
+    // split on commas but respect quoted strings
+    int entries = 1;
     bool inQuote = false;
     QChar quoteChar;
-    for( int i = 0; i < s.size(); ++i ) {
+    for( int i = from; i < to; ++i ) {
         const QChar c = s[i];
         if( !inQuote && (c == '"' || c == '\'') ) {
             inQuote = true;
             quoteChar = c;
-            acc.append(c);
-        } else if( inQuote && c == quoteChar ) {
+        } else if( inQuote && c == quoteChar )
             inQuote = false;
-            acc.append(c);
-        } else if( !inQuote && c == ',' ) {
-            out.append(acc);
-            acc.clear();
-        } else {
-            acc.append(c);
-        }
-    }
-    out.append(acc);
-    return out;
-}
-
-QMap<QString, QString> Parser::parseAttrList(const QString& bracketed, int lineNo)
-{
-    QMap<QString, QString> res;
-    const QString inner = stripOuter(bracketed.trimmed(), '[', ']');
-    if( inner.isEmpty() )
-        return res;
-    const QStringList parts = splitAttrComma(inner);
-
-    for( int i = 0; i < parts.size(); ++i ) {
-        if( parts[i].trimmed().isEmpty() && parts.size() > 1)
-            error("empty attribute entry (trailing, leading, or double comma)", lineNo);
+        else if( !inQuote && c == ',' )
+            entries++;
     }
 
-    int posIdx = 0;
-    for( int i = 0; i < parts.size(); ++i ) {
-        const QString p = parts[i].trimmed();
-        if( p.isEmpty())
+    bool hasId = false;
+    int start = from;
+    inQuote = false;
+    for( int i = from; i <= to; ++i ) {
+        if( i < to ) {
+            const QChar c = s[i];
+            if( !inQuote && (c == '"' || c == '\'') ) {
+                inQuote = true;
+                quoteChar = c;
+                continue;
+            } else if( inQuote && c == quoteChar ) {
+                inQuote = false;
+                continue;
+            } else if( inQuote || c != ',' )
+                continue;
+        }
+        int a = start;
+        int b = i;
+        start = i + 1;
+        while( a < b && s[a].isSpace() )
+            ++a;
+        while( b > a && s[b-1].isSpace() )
+            --b;
+        if( a == b ) {
+            if( entries > 1 )
+                error("empty attribute entry (trailing, leading, or double comma)", lineNo);
             continue;
-        int eq = p.indexOf('=');
-        if( eq > 0) {
-            const QString key = p.left(eq).trimmed();
+        }
+        int eq = a;
+        while( eq < b && s[eq] != '=' )
+            ++eq;
+        if( eq > a && eq < b ) {
+            int ke = eq;
+            while( ke > a && s[ke-1].isSpace() )
+                --ke;
             // validate attribute key name
-            if( !isValidIdentifier(key))
-                error("invalid attribute key '" + key +
+            if( !isValidIdentifier(s.constData() + a, ke - a))
+                error("invalid attribute key '" + s.mid(a, ke - a) +
                       "'; must match IDENTIFIER (letter or underscore, then letters/digits/underscore/hyphen)", lineNo);
-            res.insert(key, p.mid(eq+1).trimmed());
-        } else if( posIdx == 0) {
-            res.insert("positional0", p);
-            ++posIdx;
-        } else {
-            res.insert(QString("positional%1").arg(posIdx), p);
-            ++posIdx;
-        }
+        } else if( s[a] == '#' )
+            hasId = true;
     }
-    return res;
+    return hasId;
+}
+
+Parser::~Parser()
+{
+    dmemo.clear();
+}
+
+void Parser::InlineMemo::clear()
+{
+    QHash<QString, QList<Node*> >::ConstIterator it;
+    for( it = trees.constBegin(); it != trees.constEnd(); ++it )
+        for( int i = 0; i < it.value().size(); ++i )
+            Node::deleteTree(it.value()[i]);
+    trees.clear();
+    seen.clear();
 }
 
 Node* Parser::parse(const QString& input)
 {
-    errors.clear();
-    dlex.setInput(input);
-    return parseDocument();
+    Node* doc = parseHeader(input);
+    while( Node* b = parseNextBlock() )
+        doc->add(b);
+    return doc;
 }
 
-Node* Parser::parseDocument()
+Node* Parser::parseHeader(const QString& input)
 {
-    Node* doc = new Node(Node::K_Document);
+    errors.clear();
+    dmemo.clear();
+    dlex.setInput(input);
+
+    Document* doc = new Document();
     doc->pos = RowCol(1, 1);
+    dpool = &doc->strings;
+    dmetas = &doc->sharedMetas;
 
     // skip leading comments and blanks before header
     while( la(0).kind == LineTok::T_BLANK || la(0).kind == LineTok::T_LINE_COMMENT) {
-        if( la(0).kind == LineTok::T_LINE_COMMENT) {
+        if( la(0).kind == LineTok::T_LINE_COMMENT && dopt.keepComments) {
             Node* c = new Node(Node::K_LineComment);
             c->pos = RowCol(la(0).lineNo, 1);
             c->text = la(0).raw.trimmed().mid(2);
@@ -314,16 +353,19 @@ Node* Parser::parseDocument()
     }
     parseDocumentHeader(doc);
     skipBlankLines();
+    return doc;
+}
 
-    while( !dlex.atEnd()) {
+Node* Parser::parseNextBlock()
+{
+    for(;;) {
         skipBlankLines();
         if( dlex.atEnd())
-            break;
+            return 0;
         Node* b = parseBlock();
-        if( !b) break;
-        doc->add(b);
+        if( !b || !dropBlock(b) )
+            return b;
     }
-    return doc;
 }
 
 void Parser::parseDocumentHeader(Node* doc)
@@ -384,63 +426,93 @@ void Parser::parseDocumentHeader(Node* doc)
     }
 }
 
+namespace {
+struct NestingGuard {
+    int& level;
+    NestingGuard(int& l):level(l) { level++; }
+    ~NestingGuard() { level--; }
+};
+}
+
 Node* Parser::parseBlock()
 {
-    BlockMeta* meta = parseBlockMetaOpt();
-    if( meta )
-        skipBlankLines(); // block meta may be separated from its block by blank lines
-    const int k = la(0).kind;
-
-    if( meta && k == LineTok::T_EOF) {
-        error("dangling block metadata (anchor/attributes/title) not followed by any block",
-              meta->pos.row);
-        delete meta;
-        return 0;
-    }
+    NestingGuard guard(dnesting);
+
+    // lines which cannot start a block are skipped here, not by calling parseBlock again, so
+    // a long run of them cannot exhaust the stack
+    for(;;) {
+        const int metaLine = la(0).lineNo;
+        BlockMeta* meta = parseBlockMetaOpt();
+        if( meta )
+            skipBlankLines(); // block meta may be separated from its block by blank lines
+        const int k = la(0).kind;
+
+        if( meta && k == LineTok::T_EOF) {
+            error("dangling block metadata (anchor/attributes/title) not followed by any block",
+                  metaLine);
+            BlockMeta::release(meta);
+            return 0;
+        }
 
-    if( FIRST_section(k))
-        return parseSection(meta);
-    if( k == LineTok::T_ADMONITION)
-        return parseAdmonitionParagraph(meta);
-    if( FIRST_list(k))
-        return parseList(meta);
-    if( k == LineTok::T_TABLE_DELIM)
-        return parseTable(meta);
-    if( FIRST_delimited(k))
-        return parseDelimited(meta);
-    if( k == LineTok::T_BLOCK_MACRO)
-        return parseBlockMacro(meta);
-    if( k == LineTok::T_DIRECTIVE)
-        return parseDirective(meta);
-    if( k == LineTok::T_THEMATIC || k == LineTok::T_LINE_COMMENT)
-        return parseBreakOrComment(meta);
-    if( k == LineTok::T_PAGEBREAK) {
-        error("page break '<<<' is not supported by LeanDoc", la(0).lineNo);
-        take();
-        delete meta;
-        return parseBlock();
-    }
-    if( k == LineTok::T_LIST_CONT) {
-        error("list continuation '+' outside of a list context", la(0).lineNo);
-        take();
-        delete meta;
-        return parseBlock();
-    }
-    if( k == LineTok::T_TEXT) {
-        warnNearMissDelimiter(la(0).raw, la(0).lineNo);
-        return parseParagraphOrLiteral(meta);
-    }
+        Node* n = 0;
+        bool parsed = true;
+        if( FIRST_section(k))
+            n = parseSection(meta);
+        else if( k == LineTok::T_ADMONITION)
+            n = parseAdmonitionParagraph(meta);
+        else if( FIRST_list(k))
+            n = parseList(meta);
+        else if( k == LineTok::T_TABLE_DELIM)
+            n = parseTable(meta);
+        else if( FIRST_delimited(k))
+            n = parseDelimited(meta);
+        else if( k == LineTok::T_BLOCK_MACRO)
+            n = parseBlockMacro(meta);
+        else if( k == LineTok::T_DIRECTIVE)
+            n = parseDirective(meta);
+        else if( k == LineTok::T_THEMATIC || k == LineTok::T_LINE_COMMENT)
+            n = parseBreakOrComment(meta);
+        else if( k == LineTok::T_TEXT) {
+            warnNearMissDelimiter(la(0).raw, la(0).lineNo);
+            n = parseParagraphOrLiteral(meta);
+        } else
+            parsed = false;
+        if( parsed ) {
+            // shared metadata has the line of its first use
+            if( n && meta && n->meta == meta )
+                n->metaRow = metaLine;
+            return n;
+        }
 
-    // unexpected token: skip and retry
-    if( k != LineTok::T_EOF) {
-        error("unexpected token", la(0).lineNo);
+        BlockMeta::release(meta);
+        if( k == LineTok::T_EOF)
+            return 0;
+
+        if( k == LineTok::T_PAGEBREAK)
+            error("page break '<<<' is not supported by LeanDoc", la(0).lineNo);
+        else if( k == LineTok::T_LIST_CONT)
+            error("list continuation '+' outside of a list context", la(0).lineNo);
+        else
+            error("unexpected token", la(0).lineNo);
+        // skip and retry
         take();
-        delete meta;
-        return parseBlock();
     }
+}
 
-    delete meta;
-    return 0;
+bool Parser::checkNesting(int lineNo)
+{
+    if( dnesting < MaxNesting )
+        return true;
+    error("blocks nested deeper than " + QString::number(MaxNesting) + " levels", lineNo);
+    return false;
+}
+
+void Parser::checkMacro(const Node* n)
+{
+    const MacroRegistry::Macro* def = MacroRegistry::instance().find(n->atom);
+    QString msg;
+    if( def && def->check && !def->check(n, &msg) )
+        error(n->name + ": " + msg, n->pos.row);
 }
 
 BlockMeta* Parser::parseBlockMetaOpt()
@@ -449,17 +521,22 @@ BlockMeta* Parser::parseBlockMetaOpt()
 
     BlockMeta* m = new BlockMeta();
     m->pos = RowCol(la(0).lineNo, 1);
+    const int errorCount = errors.size();
+    bool attrsOnly = true;
+    QString key; // the attribute lines, to share identical metadata
 
     while( FIRST_blockMeta(la(0).kind)) {
+        if( la(0).kind != LineTok::T_BLOCK_ATTRS )
+            attrsOnly = false;
         if( la(0).kind == LineTok::T_BLOCK_ANCHOR) {
             const int anchorLine = la(0).lineNo;
             const QString s = take().raw.trimmed();
             const QString inner = s.mid(2, s.size()-4);
             int comma = inner.indexOf(',');
             if( comma < 0 )
-                m->anchorId = inner.trimmed();
+                m->anchorId = dpool->intern(inner.trimmed());
             else {
-                m->anchorId = inner.left(comma).trimmed();
+                m->anchorId = dpool->intern(inner.left(comma).trimmed());
                 m->anchorText = inner.mid(comma+1).trimmed();
             }
             if( !m->anchorId.isEmpty() && !isValidIdentifier(m->anchorId))
@@ -469,18 +546,15 @@ BlockMeta* Parser::parseBlockMetaOpt()
         } else if( la(0).kind == LineTok::T_BLOCK_ATTRS) {
             const int attrLine = la(0).lineNo;
             const QString s = take().raw.trimmed();
-            QMap<QString, QString> a = parseAttrList(s, attrLine);
-            for( QMap<QString, QString>::ConstIterator it = a.constBegin(); it != a.constEnd(); ++it) {
-                const QString& val = it.value();
-                // handle AsciiDoc shorthand: [#id] [.role] [%option]
-                if( it.key().startsWith("positional") && val.startsWith('#'))
-                    m->anchorId = val.mid(1);
-                else if( it.key().startsWith("positional") && val.startsWith('.'))
-                    m->roles.append(val.mid(1));
-                else if( it.key().startsWith("positional") && val.startsWith('%'))
-                    m->attrs.insert("options", val.mid(1));
-                else
-                    m->attrs.insert(it.key(), val);
+            if( attrsOnly )
+                key += s + '\n';
+            m->attrLines.append(s);
+            // the attributes are built on demand, only the [#id] shorthand is needed now
+            if( checkAttrList(s, attrLine) ) {
+                const AttrMap a = BlockMeta::parseAttrList(s);
+                for( AttrMap::ConstIterator it = a.constBegin(); it != a.constEnd(); ++it)
+                    if( it.isPositional() && it.value().startsWith('#'))
+                        m->anchorId = dpool->mid(it.value(), 1);
             }
         } else if( la(0).kind == LineTok::T_BLOCK_TITLE) {
             const QString s = take().raw.trimmed();
@@ -488,6 +562,15 @@ BlockMeta* Parser::parseBlockMetaOpt()
         }
     }
 
+    // metadata with errors is not shared, so each occurrence reports them
+    if( !attrsOnly || !m->anchorId.isEmpty() || errors.size() != errorCount || dmetas == 0 )
+        return m;
+    BlockMeta* shared = dmetas->value(key);
+    if( shared ) {
+        BlockMeta::release(m);
+        return shared->retain();
+    }
+    dmetas->insert(key, m->retain());
     return m;
 }
 
@@ -502,6 +585,8 @@ Node* Parser::parseSection(BlockMeta* m)
     n->level = lvl;
     n->name = sectionTitle(t.raw);
     n->titleChildren = parseInlineContent(n->name, t.lineNo);
+    if( !dopt.keepRawTitles && !n->titleChildren.isEmpty() )
+        n->name.clear(); // the generator only falls back to it if there are no titleChildren
 
     while( !dlex.atEnd() ) {
         skipBlankLines();
@@ -545,7 +630,7 @@ Node* Parser::parseSection(BlockMeta* m)
         Node* b = parseBlock();
         if( !b )
             break;
-        n->add(b);
+        addBlock(n, b);
     }
     return n;
 }
@@ -595,7 +680,7 @@ Node* Parser::parseAdmonitionParagraph(BlockMeta* m)
     Node* a = new Node(Node::K_AdmonitionParagraph);
     a->pos = RowCol(t.lineNo, 1);
     a->meta = m;
-    a->name = s.left(colon);
+    a->name = dpool->mid(s, 0, colon);
     a->children = parseInlineContent(s.mid(colon+1).trimmed(), t.lineNo);
     return a;
 }
@@ -612,6 +697,8 @@ Node* Parser::parseDelimited(BlockMeta* m)
 
     bool rawOnly = (k == LineTok::T_DELIM_LISTING || k == LineTok::T_DELIM_LITERAL ||
                     k == LineTok::T_DELIM_COMMENT);
+    if( !rawOnly && !checkNesting(open.lineNo) )
+        rawOnly = true; // the content is kept, but not parsed
 
     if( rawOnly) {
         QStringList lines;
@@ -622,7 +709,8 @@ Node* Parser::parseDelimited(BlockMeta* m)
                   "' opened at line " + QString::number(open.lineNo) + ")", la(0).lineNo);
         else
             take();
-        b->text = lines.join("\n");
+        if( b->delimKind != Node::DK_Comment || dopt.keepComments )
+            b->text = lines.join("\n");
         return b;
     }
 
@@ -634,7 +722,7 @@ Node* Parser::parseDelimited(BlockMeta* m)
         Node* inner = parseBlock();
         if( !inner )
             break;
-        b->add(inner);
+        addBlock(b, inner);
     }
     if( dlex.atEnd() || la(0).kind != k)
         error("unclosed delimited block ('" + open.raw.trimmed() +
@@ -675,7 +763,7 @@ Node* Parser::parseList(BlockMeta* m)
             Node* item = new Node(Node::K_ListItem);
             item->pos = RowCol(termTok.lineNo, 1);
             item->level = c;
-            item->name = ts.left(ts.size()-c).trimmed();
+            item->name = dpool->intern(ts.left(ts.size()-c).trimmed());
 
             // optional definition on next line(s)
             if( la(0).kind == LineTok::T_TEXT && !la(0).raw.trimmed().isEmpty()) {
@@ -759,10 +847,14 @@ Node* Parser::parseList(BlockMeta* m)
         // list continuations (repeatable)
         skipBlankLines();
         while( la(0).kind == LineTok::T_LIST_CONT) {
+            if( !checkNesting(la(0).lineNo) ) {
+                take();
+                break;
+            }
             take();
             skipBlankLines();
             Node* cont = parseBlock();
-            if( cont) item->add(cont);
+            if( cont) addBlock(item, cont);
             skipBlankLines();
         }
 
@@ -790,9 +882,9 @@ QList<Node*> Parser::readCells(const LineTok& rowTok)
 
 static int colsCount(const BlockMeta* m)
 {
-    if( !m || !m->attrs.contains("cols"))
+    if( !m || !m->attrs().contains(Atom::A_cols))
         return 0;
-    QString v = m->attrs.value("cols");
+    QString v = m->attrs().value(Atom::A_cols);
     if( v.startsWith('"') && v.endsWith('"'))
         v = v.mid(1, v.size()-2);
     if( v.isEmpty())
@@ -804,7 +896,7 @@ Node* Parser::parseTable(BlockMeta* m)
 {
     LineTok open = la(0);
     if( !expect(LineTok::T_TABLE_DELIM, "table")) {
-        delete m;
+        BlockMeta::release(m);
         return 0;
     }
 
@@ -870,7 +962,7 @@ Node* Parser::parseTable(BlockMeta* m)
 
     // blank line after first row promotes it to header
     if( firstBlankPos == nCols)
-        t->kv.insert("header", "true");
+        t->kv.insert(Atom::A_header, "true");
 
     return t;
 }
@@ -884,8 +976,10 @@ Node* Parser::parseBlockMacro(BlockMeta* m)
     Node* n = new Node(Node::K_BlockMacro);
     n->pos = RowCol(t.lineNo, 1);
     n->meta = m;
-    n->name = s.left(p);
-    n->target = s.mid(p+2);
+    n->name = dpool->mid(s, 0, p);
+    n->atom = Atom::lookup(n->name); // Null for names which are neither predefined nor registered
+    n->target = dpool->mid(s, p+2);
+    checkMacro(n);
     return n;
 }
 
@@ -898,14 +992,16 @@ Node* Parser::parseDirective(BlockMeta* m)
     Node* n = new Node(Node::K_Directive);
     n->pos = RowCol(t.lineNo, 1);
     n->meta = m;
-    n->name = s.left(p);
-    n->text = s.mid(p+2);
+    n->name = dpool->mid(s, 0, p);
+    n->atom = Atom::lookup(n->name); // Null for names which are neither predefined nor registered
+    n->text = dpool->mid(s, p+2);
 
-    if( n->name == "ifeval")
+    if( n->atom == Atom::A_ifeval)
         error("'ifeval' directive is not supported by LeanDoc", t.lineNo);
 
     // ifdef/ifndef: collect body until endif::
-    if( n->name == "ifdef" || n->name == "ifndef" || n->name == "ifeval") {
+    if( (n->atom == Atom::A_ifdef || n->atom == Atom::A_ifndef || n->atom == Atom::A_ifeval) &&
+            checkNesting(t.lineNo) ) {
         while( !dlex.atEnd()) {
             skipBlankLines();
             if( la(0).kind == LineTok::T_DIRECTIVE) {
@@ -915,8 +1011,9 @@ Node* Parser::parseDirective(BlockMeta* m)
                     int ep = ds.indexOf("::");
                     Node* endNode = new Node(Node::K_Directive);
                     endNode->pos = RowCol(endTok.lineNo, 1);
-                    endNode->name = ds.left(ep);
-                    endNode->text = ds.mid(ep+2);
+                    endNode->atom = Atom::A_endif;
+                    endNode->name = Atom::name(Atom::A_endif);
+                    endNode->text = dpool->mid(ds, ep+2);
                     n->add(endNode);
                     break;
                 }
@@ -926,7 +1023,7 @@ Node* Parser::parseDirective(BlockMeta* m)
             Node* body = parseBlock();
             if( !body)
                 break;
-            n->add(body);
+            addBlock(n, body);
         }
     }
 
@@ -957,13 +1054,44 @@ Node* Parser::parseBreakOrComment(BlockMeta* m)
         pb->meta = m;
         return pb;
     }
-    delete m;
+    BlockMeta::release(m);
     return 0;
 }
 
 QList<Node*> Parser::parseInlineContent(const QString& s, int lineNo)
 {
-    return parseInlineContentRec(s, lineNo, 0);
+    // inline parsing depends on nothing but s, so the nodes can be copied; long texts rarely
+    // repeat and are not worth the lookup, and texts with errors (from macro checks) are
+    // parsed again to report them at each occurrence
+    if( s.size() > InlineMemo::MaxLen )
+        return parseInlineContentRec(s, lineNo, 0);
+    dmemo.lookups++;
+    QList<Node*> res;
+    QHash<QString, QList<Node*> >::ConstIterator it = dmemo.trees.constFind(s);
+    if( it != dmemo.trees.constEnd() ) {
+        dmemo.hits++;
+        for( int i = 0; i < it.value().size(); ++i )
+            res.append(it.value()[i]->clone(lineNo));
+        return res;
+    }
+    const int errorCount = errors.size();
+    res = parseInlineContentRec(s, lineNo, 0);
+    if( errors.size() != errorCount )
+        return res;
+    const uint h = qHash(s);
+    if( !dmemo.seen.contains(h) ) {
+        if( dmemo.seen.size() >= InlineMemo::MaxSeen )
+            dmemo.seen.clear();
+        dmemo.seen.insert(h);
+        return res;
+    }
+    if( dmemo.trees.size() >= InlineMemo::MaxEntries )
+        dmemo.clear();
+    QList<Node*> tree;
+    for( int i = 0; i < res.size(); ++i )
+        tree.append(res[i]->clone(lineNo));
+    dmemo.trees.insert(s, tree);
+    return res;
 }
 
 void Parser::pushText(QList<Node*>& out, const QString& t, int lineNo)
@@ -972,11 +1100,11 @@ void Parser::pushText(QList<Node*>& out, const QString& t, int lineNo)
         return;
     Node* n = new Node(Node::K_Text);
     n->pos = RowCol(lineNo, 1);
-    n->text = t;
+    n->text = dpool->intern(t);
     out.append(n);
 }
 
-QList<Node*> Parser::parseInlineContentRec(const QString& s, int lineNo, int depth)
+QList<Node*> Parser::parseInlineContentRec(const QString& s, int lineNo, int depth, bool replace)
 {
     QList<Node*> out;
     if( depth > 8) {
@@ -984,13 +1112,16 @@ QList<Node*> Parser::parseInlineContentRec(const QString& s, int lineNo, int dep
         return out;
     }
 
+    const Replacements& repl = Replacements::instance();
+    int rstate = 0;
     QString acc;
     int i = 0;
     while( i < s.size()) {
 
-        // escape: \CHAR produces literal CHAR
+        // escape: \CHAR produces literal CHAR, which takes part in no replacement
         if( s[i] == '\\' && i + 1 < s.size()) {
             acc.append(s[i+1]);
+            rstate = 0;
             i += 2;
             continue;
         }
@@ -1012,13 +1143,40 @@ QList<Node*> Parser::parseInlineContentRec(const QString& s, int lineNo, int dep
                 pushText(out, acc, lineNo); acc.clear();
                 Node* ar = new Node(Node::K_AttrRef);
                 ar->pos = RowCol(lineNo, 1);
-                ar->name = s.mid(i+1, j-(i+1));
+                ar->name = dpool->mid(s, i+1, j-(i+1));
                 out.append(ar);
                 i = j + 1;
                 continue;
             }
         }
 
+        // index terms: (((primary, secondary, tertiary))) is concealed, ((term)) is also shown
+        if( matchAt(s, i, "(((", 3)) {
+            int j = findDelim(s, i+3, ")))", 3);
+            if( j > i+3) {
+                pushText(out, acc, lineNo); acc.clear();
+                Node* it = new Node(Node::K_IndexTerm);
+                it->pos = RowCol(lineNo, 1);
+                it->text = dpool->mid(s, i+3, j-(i+3));
+                out.append(it);
+                i = j + 3;
+                continue;
+            }
+        }
+        if( matchAt(s, i, "((", 2)) {
+            int j = findDelim(s, i+2, "))", 2);
+            if( j > i+2) {
+                pushText(out, acc, lineNo); acc.clear();
+                Node* it = new Node(Node::K_IndexTerm);
+                it->pos = RowCol(lineNo, 1);
+                it->text = dpool->mid(s, i+2, j-(i+2));
+                it->children = parseInlineContentRec(it->text, lineNo, depth+1, replace);
+                out.append(it);
+                i = j + 2;
+                continue;
+            }
+        }
+
         // cross-reference <<id,text>>
         if( matchAt(s, i, "<<", 2)) {
             int j = findDelim(s, i+2, ">>", 2);
@@ -1029,10 +1187,10 @@ QList<Node*> Parser::parseInlineContentRec(const QString& s, int lineNo, int dep
                 const QString inner = s.mid(i+2, j-(i+2));
                 int comma = inner.indexOf(',');
                 if( comma < 0)
-                    xr->target = inner.trimmed();
+                    xr->target = dpool->intern(inner.trimmed());
                 else {
-                    xr->target = inner.left(comma).trimmed();
-                    xr->children = parseInlineContentRec(inner.mid(comma+1).trimmed(), lineNo, depth+1);
+                    xr->target = dpool->intern(inner.left(comma).trimmed());
+                    xr->children = parseInlineContentRec(inner.mid(comma+1).trimmed(), lineNo, depth+1, replace);
                 }
                 out.append(xr);
                 i = j + 2;
@@ -1047,7 +1205,7 @@ QList<Node*> Parser::parseInlineContentRec(const QString& s, int lineNo, int dep
                 pushText(out, acc, lineNo); acc.clear();
                 Node* an = new Node(Node::K_AnchorInline);
                 an->pos = RowCol(lineNo, 1);
-                an->name = s.mid(i+3, j-(i+3));
+                an->name = dpool->mid(s, i+3, j-(i+3));
                 out.append(an);
                 i = j + 3;
                 continue;
@@ -1061,7 +1219,7 @@ QList<Node*> Parser::parseInlineContentRec(const QString& s, int lineNo, int dep
                 pushText(out, acc, lineNo); acc.clear();
                 Node* an = new Node(Node::K_AnchorInline);
                 an->pos = RowCol(lineNo, 1);
-                an->name = s.mid(i+2, j-(i+2));
+                an->name = dpool->mid(s, i+2, j-(i+2));
                 out.append(an);
                 i = j + 2;
                 continue;
@@ -1076,12 +1234,12 @@ QList<Node*> Parser::parseInlineContentRec(const QString& s, int lineNo, int dep
                 ++j;
             Node* lk = new Node(Node::K_Link);
             lk->pos = RowCol(lineNo, 1);
-            lk->target = s.mid(i, j-i);
+            lk->target = dpool->mid(s, i, j-i);
             // URL[text]
             if( j < s.size() && s[j] == '[') {
                 int rb = s.indexOf(']', j+1);
                 if( rb > j) {
-                    lk->children = parseInlineContentRec(s.mid(j+1, rb-(j+1)), lineNo, depth+1);
+                    lk->children = parseInlineContentRec(s.mid(j+1, rb-(j+1)), lineNo, depth+1, replace);
                     j = rb + 1;
                 }
             }
@@ -1094,23 +1252,31 @@ QList<Node*> Parser::parseInlineContentRec(const QString& s, int lineNo, int dep
         if( s[i].isLetter()) {
             int colon = s.indexOf(':', i);
             if( colon > i && colon + 1 < s.size() && s[colon+1] != ':' && s[colon+1] != ' ') {
-                const QString macroName = s.mid(i, colon-i);
+                const quint16 macro = Atom::lookup(s.constData() + i, colon-i);
+                const MacroRegistry::Macro* def = MacroRegistry::instance().find(macro);
 
-                if( isInlineMacroName(macroName)) {
+                if( def && (def->flags & MacroRegistry::Inline) ) {
                     int lb = s.indexOf('[', colon+1);
 
                     if( lb > colon && lb < s.size()) {
                         int rb = s.indexOf(']', lb+1);
+                        if( def->flags & MacroRegistry::RawText )
+                            while( rb > 0 && s[rb-1] == '\\' )
+                                rb = s.indexOf(']', rb+1); // "\]" is part of the content
 
                         if( rb > lb) {
                             pushText(out, acc, lineNo); acc.clear();
                             Node* mn = new Node(Node::K_InlineMacro);
                             mn->pos = RowCol(lineNo, 1);
-                            mn->name = macroName;
-                            mn->target = s.mid(colon+1, lb-(colon+1));
+                            mn->atom = macro;
+                            mn->name = Atom::name(macro);
+                            mn->target = dpool->mid(s, colon+1, lb-(colon+1));
                             const QString inner = s.mid(lb+1, rb-(lb+1));
-                            if( !inner.isEmpty())
-                                mn->children = parseInlineContentRec(inner, lineNo, depth+1);
+                            if( def->flags & MacroRegistry::RawText )
+                                mn->text = QString(inner).replace("\\]", "]").trimmed(); // not markup
+                            else if( !inner.isEmpty())
+                                mn->children = parseInlineContentRec(inner, lineNo, depth+1, replace);
+                            checkMacro(mn);
                             out.append(mn);
                             i = rb + 1;
                             continue;
@@ -1120,6 +1286,21 @@ QList<Node*> Parser::parseInlineContentRec(const QString& s, int lineNo, int dep
             }
         }
 
+        // smart quotes "`text`" and '`text`'
+        if( (s[i] == '"' || s[i] == '\'') && i + 1 < s.size() && s[i+1] == '`') {
+            const bool dbl = s[i] == '"';
+            const int j = findDelim(s, i+2, dbl ? "`\"" : "`'", 2);
+            if( j > i+2) {
+                acc.append(QChar(dbl ? 0x201C : 0x2018));
+                pushText(out, acc, lineNo); acc.clear();
+                out += parseInlineContentRec(s.mid(i+2, j-(i+2)), lineNo, depth+1, replace);
+                acc.append(QChar(dbl ? 0x201D : 0x2019));
+                rstate = 0;
+                i = j + 2;
+                continue;
+            }
+        }
+
         // formatting delimiters (table-driven)
         {
             bool matched = false;
@@ -1134,10 +1315,13 @@ QList<Node*> Parser::parseInlineContentRec(const QString& s, int lineNo, int dep
                         Node* n = new Node(dl.kind);
                         n->pos = RowCol(lineNo, 1);
                         const QString inner = s.mid(i + dl.openLen, j - (i + dl.openLen));
+                        // the content of monospace, super- and subscript is shown as written
                         if( dl.recurse)
-                            n->children = parseInlineContentRec(inner, lineNo, depth+1);
+                            n->children = parseInlineContentRec(inner, lineNo, depth+1,
+                                    replace && dl.kind != Node::K_Monospace &&
+                                    dl.kind != Node::K_Superscript && dl.kind != Node::K_Subscript);
                         else
-                            n->text = inner;
+                            n->text = dpool->intern(inner);
                         out.append(n);
                         i = j + dl.closeLen;
                         matched = true;
@@ -1149,8 +1333,22 @@ QList<Node*> Parser::parseInlineContentRec(const QString& s, int lineNo, int dep
                 continue;
         }
 
-        // default: accumulate character
+        // default: accumulate character; the text replacements only see characters which
+        // directly follow each other in acc and s
+        if( acc.isEmpty() )
+            rstate = 0; // a node was added in between
         acc.append(s[i]);
+        const int r = replace ? repl.step(rstate, s[i]) : -1;
+        if( r >= 0 ) {
+            const int len = Replacements::length(r);
+            const QChar before = i - len >= 0 ? s[i - len] : QChar();
+            const QChar after = i + 1 < s.size() ? s[i + 1] : QChar();
+            if( Replacements::isAccepted(r, before, after) ) {
+                acc.chop(len);
+                acc.append(Replacements::replacement(r));
+                rstate = 0;
+            }
+        }
         ++i;
     }
 
@@ -23,6 +23,8 @@
 #include <QtCore/QString>
 #include <QtCore/QStringList>
 #include <QtCore/QMap>
+#include <QtCore/QHash>
+#include <QtCore/QSet>
 #include "LeanDocAst2.h"
 #include "LeanDocLexer2.h"
 
@@ -30,7 +32,36 @@ namespace LeanDoc {
 
 class Parser {
 public:
-    Node* parse(const QString& input);
+    enum { MaxNesting = 64 }; // of block containers, bounds the recursion of all passes
+
+    // a pipeline which only renders can drop what no later phase looks at
+    struct Options {
+        bool keepComments;  // line comments and the bodies of comment blocks
+        bool keepRawTitles; // the section name, when the parsed titleChildren are present
+        Options():keepComments(true),keepRawTitles(true){}
+    };
+
+    explicit Parser(const Options& opt = Options()):dopt(opt),dpool(0),dmetas(0),dnesting(0){}
+    ~Parser();
+    Node* parse(const QString& input); // returns a Document
+
+    // incremental use: the Document with the header only, then one top-level block per call
+    // until 0; the Document must be kept until the last block was parsed, it owns the strings
+    Node* parseHeader(const QString& input);
+    Node* parseNextBlock();
+
+    // inline parse results are reused for repeated short texts, like "N/A" in table cells; a
+    // text is only stored when it occurs the second time, most texts are unique
+    struct InlineMemo {
+        enum { MaxLen = 256, MaxEntries = 4096, MaxSeen = 4 * MaxEntries };
+        QHash<QString, QList<Node*> > trees; // owned, copied on each hit
+        QSet<uint> seen; // hashes of the texts parsed once; a collision only stores a text early
+        int lookups;
+        int hits;
+        InlineMemo():lookups(0),hits(0){}
+        void clear();
+    };
+    const InlineMemo& inlineMemo() const { return dmemo; }
 
     struct Error {
         RowCol pos;
@@ -41,7 +72,6 @@ public:
     QList<Error> errors;
 
 private:
-    Node* parseDocument();
     void parseDocumentHeader(Node* doc);
 
     Node* parseBlock();
@@ -57,7 +87,7 @@ private:
     Node* parseBreakOrComment(BlockMeta* m);
 
     QList<Node*> parseInlineContent(const QString& s, int lineNo);
-    QList<Node*> parseInlineContentRec(const QString& s, int lineNo, int depth);
+    QList<Node*> parseInlineContentRec(const QString& s, int lineNo, int depth, bool replace = true);
     void pushText(QList<Node*>& out, const QString& t, int lineNo);
     QList<Node*> readCells(const LineTok& rowTok);
 
@@ -67,12 +97,20 @@ private:
     bool expect(LineTok::Kind k, const char* where);
     void error(const QString& msg, int row, int col = 1);
     void skipBlankLines();
+    bool dropBlock(Node* b);
+    void addBlock(Node* parent, Node* b);
+    bool checkNesting(int lineNo);
+    void checkMacro(const Node* n);
 
-    QMap<QString, QString> parseAttrList(const QString& bracketed, int lineNo);
-    static QString stripOuter(const QString& s, QChar a, QChar b);
+    bool checkAttrList(const QString& line, int lineNo);
     void warnNearMissDelimiter(const QString& s, int lineNo);
 
+    Options dopt;
     Lexer dlex;
+    StringPool* dpool; // of the document being parsed
+    QHash<QString, BlockMeta*>* dmetas; // of the document being parsed
+    InlineMemo dmemo;
+    int dnesting; // active parseBlock calls
 };
 
 } // namespace LeanDoc
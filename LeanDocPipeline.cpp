@@ -0,0 +1,159 @@
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the LeanDoc document language project.
+*
+* The following is the license that applies to this copy of the
+* file. For a license to use the file under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "LeanDocPipeline.h"
+#include <QtCore/QThread>
+#include <QtCore/QTextStream>
+using namespace LeanDoc;
+
+namespace LeanDoc {
+class PipelineWorker : public QThread {
+public:
+    PipelineWorker(Pipeline* p, int stage):dp(p),dstage(stage){}
+protected:
+    void run()
+    {
+        dp->stageLoop(dstage);
+    }
+private:
+    Pipeline* dp;
+    int dstage;
+};
+}
+
+Pipeline::Pipeline(const QStringList& stages, bool serial, int queueCapacity):
+    delapsed(0),dserial(serial),dfinished(false)
+{
+    dtimer.start();
+    for( int i = 0; i < stages.size(); ++i ) {
+        Stats s;
+        s.name = stages[i];
+        dstats.append(s);
+    }
+    if( dserial )
+        return;
+    for( int i = 1; i < stages.size(); ++i )
+        dqueues.append(new BoundedQueue<PipelineJob*>(queueCapacity));
+    for( int i = 1; i < stages.size(); ++i ) {
+        dworkers.append(new PipelineWorker(this, i));
+        dworkers.last()->start();
+    }
+}
+
+Pipeline::~Pipeline()
+{
+    finish();
+    for( int i = 0; i < dworkers.size(); ++i )
+        delete dworkers[i];
+    for( int i = 0; i < dqueues.size(); ++i )
+        delete dqueues[i];
+}
+
+void Pipeline::sourceDone(qint64 busy, qint64 starved)
+{
+    dstats[0].jobs++;
+    dstats[0].busy += busy;
+    dstats[0].starved += starved;
+}
+
+void Pipeline::push(PipelineJob* job)
+{
+    if( !dserial ) {
+        if( dqueues.isEmpty() )
+            delete job;
+        else
+            dstats[0].blocked += dqueues.first()->push(job);
+        return;
+    }
+    for( int i = 1; i < dstats.size(); ++i ) {
+        QElapsedTimer timer;
+        timer.start();
+        job->run(i);
+        dstats[i].jobs++;
+        dstats[i].busy += timer.nsecsElapsed();
+    }
+    delete job;
+}
+
+void Pipeline::finish()
+{
+    if( dfinished )
+        return;
+    dfinished = true;
+    if( !dqueues.isEmpty() )
+        dqueues.first()->close(); // each stage closes the next queue when its input is drained
+    for( int i = 0; i < dworkers.size(); ++i )
+        dworkers[i]->wait();
+    delapsed = dtimer.nsecsElapsed();
+}
+
+void Pipeline::stageLoop(int stage)
+{
+    // only this thread writes dstats[stage]
+    BoundedQueue<PipelineJob*>* in = dqueues[stage - 1];
+    BoundedQueue<PipelineJob*>* next = stage < dqueues.size() ? dqueues[stage] : 0;
+    Stats& s = dstats[stage];
+    for(;;) {
+        PipelineJob* job = 0;
+        bool ok;
+        s.starved += in->pop(&job, &ok);
+        if( !ok )
+            break;
+        QElapsedTimer timer;
+        timer.start();
+        job->run(stage);
+        s.busy += timer.nsecsElapsed();
+        s.jobs++;
+        if( next )
+            s.blocked += next->push(job);
+        else
+            delete job;
+    }
+    if( next )
+        next->close();
+}
+
+QList<Pipeline::Stats> Pipeline::stats() const
+{
+    return dstats;
+}
+
+QString Pipeline::report() const
+{
+    // the stage with the highest share of busy time limits the throughput
+    int bottleneck = 0;
+    for( int i = 1; i < dstats.size(); ++i )
+        if( dstats[i].busy > dstats[bottleneck].busy )
+            bottleneck = i;
+    const qint64 total = delapsed > 0 ? delapsed : 1;
+    QString res;
+    QTextStream out(&res);
+    out << "pipeline: " << (dserial ? "serial, " : "") << delapsed / 1000000 << " ms\n";
+    for( int i = 0; i < dstats.size(); ++i ) {
+        const Stats& s = dstats[i];
+        out << "  " << s.name.leftJustified(10) << " " << s.jobs << " jobs, busy "
+            << s.busy * 100 / total << "%, starved " << s.starved * 100 / total << "%, blocked "
+            << s.blocked * 100 / total << "%";
+        if( i == bottleneck )
+            out << "  <- bottleneck";
+        out << "\n";
+    }
+    out.flush();
+    return res;
+}
@@ -0,0 +1,134 @@
+#ifndef LEANDOC_PIPELINE_H
+#define LEANDOC_PIPELINE_H
+
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the LeanDoc document language project.
+*
+* The following is the license that applies to this copy of the
+* file. For a license to use the file under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QWaitCondition>
+#include <QtCore/QElapsedTimer>
+
+class QThread;
+
+namespace LeanDoc {
+
+// FIFO of limited capacity between two threads; push() blocks while it is full, which
+// slows down the producer to the pace of the consumer (back-pressure).
+template<class T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(int capacity = 2):dcap(capacity < 1 ? 1 : capacity),dclosed(false){}
+
+    // both return the nanoseconds spent waiting
+    qint64 push(const T& t)
+    {
+        QMutexLocker lock(&dlock);
+        QElapsedTimer timer;
+        timer.start();
+        while( dqueue.size() >= dcap )
+            dnotFull.wait(&dlock);
+        dqueue.append(t);
+        dnotEmpty.wakeOne();
+        return timer.nsecsElapsed();
+    }
+    qint64 pop(T* t, bool* ok) // ok is false when the queue is closed and empty
+    {
+        QMutexLocker lock(&dlock);
+        QElapsedTimer timer;
+        timer.start();
+        while( dqueue.isEmpty() && !dclosed )
+            dnotEmpty.wait(&dlock);
+        *ok = !dqueue.isEmpty();
+        if( *ok ) {
+            *t = dqueue.takeFirst();
+            dnotFull.wakeOne();
+        }
+        return timer.nsecsElapsed();
+    }
+    void close() // no more pushes
+    {
+        QMutexLocker lock(&dlock);
+        dclosed = true;
+        dnotEmpty.wakeAll();
+    }
+
+private:
+    QMutex dlock;
+    QWaitCondition dnotEmpty;
+    QWaitCondition dnotFull;
+    QList<T> dqueue;
+    int dcap;
+    bool dclosed;
+};
+
+// A job passes all stages of a Pipeline in order; stage i calls run(i). A job which has
+// nothing left to do just returns from the remaining stages.
+class PipelineJob {
+public:
+    virtual ~PipelineJob(){}
+    virtual void run(int stage) = 0;
+};
+
+// Linear stage graph with one thread per stage and bounded queues in between, so job N+1
+// is in an early stage while job N is in a later one, and at most a few jobs are in flight
+// at a time. The jobs leave the last stage in the order they were pushed.
+// The thread which pushes the jobs counts as stage 0 (the source, e.g. reading); its own time
+// is accounted with sourceDone(). In serial mode all stages run in push().
+class Pipeline {
+public:
+    struct Stats {
+        QString name;
+        int jobs;
+        qint64 busy;    // ns spent in run()
+        qint64 starved; // ns waiting for input
+        qint64 blocked; // ns waiting for room in the next queue
+        Stats():jobs(0),busy(0),starved(0),blocked(0){}
+    };
+
+    // stages[0] names the source
+    Pipeline(const QStringList& stages, bool serial, int queueCapacity = 2);
+    ~Pipeline(); // finish()
+
+    void sourceDone(qint64 busy, qint64 starved); // time the source spent on the next job
+    void push(PipelineJob* job); // takes ownership, the job is deleted after the last stage
+    void finish(); // waits until all jobs have passed
+
+    QList<Stats> stats() const; // valid after finish()
+    qint64 elapsed() const { return delapsed; } // ns from construction to finish()
+    QString report() const; // one line per stage, the bottleneck is marked
+
+private:
+    friend class PipelineWorker;
+    void stageLoop(int stage);
+
+    QList< BoundedQueue<PipelineJob*>* > dqueues; // dqueues[i] feeds stage i+1
+    QList<QThread*> dworkers;
+    QList<Stats> dstats;
+    QElapsedTimer dtimer;
+    qint64 delapsed;
+    bool dserial;
+    bool dfinished;
+};
+
+} // namespace LeanDoc
+
+#endif
@@ -19,6 +19,7 @@
 
 #include "LeanDocPreprocessor.h"
 #include "LeanDocParser2.h"
+#include "LeanDocAtoms.h"
 #include <QtCore/QFile>
 #include <QtCore/QFileInfo>
 #include <QtCore/QDir>
@@ -30,25 +31,38 @@ void Preprocessor::error(int line, const QString& msg)
 }
 
 bool Preprocessor::process(Node* doc)
+{
+    if( !begin(doc) )
+        return false;
+    processBlocks(doc);
+    return true;
+}
+
+bool Preprocessor::begin(Node* doc)
 {
     if( !doc || doc->kind != Node::K_Document)
         return false;
     errors.clear();
     collectDocAttrs(doc);
-    processChildren(doc, 0);
     return true;
 }
 
+void Preprocessor::processBlocks(Node* doc)
+{
+    processChildren(doc, 0);
+}
+
 void Preprocessor::collectDocAttrs(Node* doc)
 {
     // merge document attributes (:name: value) from doc->kv into dattrs
-    QMap<QString,QString>::ConstIterator it = doc->kv.constBegin();
+    KeyValueMap::ConstIterator it = doc->kv.constBegin();
     for( ; it != doc->kv.constEnd(); ++it) {
         if( it.key().startsWith("attr:")) {
             QString name = it.key().mid(5);
             dattrs.insert(name, it.value());
         }
     }
+    dlookupValid = false;
 }
 
 void Preprocessor::processChildren(Node* parent, int depth)
@@ -58,12 +72,12 @@ void Preprocessor::processChildren(Node* parent, int depth)
         Node* child = parent->children[i];
         if( !child) { ++i; continue; }
 
-        if( child->kind == Node::K_BlockMacro && child->name == "include") {
+        if( child->kind == Node::K_BlockMacro && child->atom == Atom::A_include) {
             if( resolveInclude(parent, i, depth))
                 continue; // index stays same, re-check replaced nodes
             ++i;
         } else if( child->kind == Node::K_Directive &&
-                   (child->name == "ifdef" || child->name == "ifndef")) {
+                   (child->atom == Atom::A_ifdef || child->atom == Atom::A_ifndef)) {
             if( evaluateConditional(parent, i))
                 continue; // re-check at same index
             ++i;
@@ -77,6 +91,10 @@ void Preprocessor::processChildren(Node* parent, int depth)
 void Preprocessor::processNode(Node* n, int depth)
 {
     substituteAttrRefs(n);
+    if( dcollectFiles ) {
+        collectImages(n->children);
+        collectImages(n->titleChildren);
+    }
 
     if( !n->children.isEmpty())
         processChildren(n, depth);
@@ -86,6 +104,74 @@ void Preprocessor::substituteAttrRefs(Node* n)
 {
     substituteInlineList(n->children);
     substituteInlineList(n->titleChildren);
+    if( !n->text.isEmpty() && hasAttributeSubs(n) )
+        n->text = substituteInText(n->text);
+}
+
+bool Preprocessor::hasAttributeSubs(const Node* n)
+{
+    // the bodies of listing and literal blocks are raw, unless subs="attributes" is given
+    if( !n->meta || !(n->kind == Node::K_LiteralParagraph ||
+                      (n->kind == Node::K_DelimitedBlock &&
+                       (n->delimKind == Node::DK_Listing || n->delimKind == Node::DK_Literal))) )
+        return false;
+    QString subs = n->meta->attrs().value(Atom::A_subs);
+    if( subs.startsWith('"') && subs.endsWith('"'))
+        subs = subs.mid(1, subs.size()-2);
+    return subs == "attributes" || subs == "+attributes";
+}
+
+static inline bool isAttrNameChar(QChar c)
+{
+    return c.isLetterOrNumber() || c == '_' || c == '-';
+}
+
+QString Preprocessor::substituteInText(const QString& s)
+{
+    if( !dlookupValid ) {
+        dlookup.clear();
+        for( QMap<QString,QString>::ConstIterator it = dattrs.constBegin(); it != dattrs.constEnd(); ++it )
+            dlookup.insert(it.key(), it.value());
+        dlookupValid = true;
+    }
+
+    // one pass over the text; the pieces between the references are copied once, a text
+    // without references is returned as is; undefined names and \{name} stay literal
+    const QChar* p = s.constData();
+    const int n = s.size();
+    QString res;
+    int copied = 0;
+    int i = s.indexOf('{');
+    while( i >= 0 ) {
+        int j = i + 1;
+        while( j < n && isAttrNameChar(p[j]) )
+            ++j;
+        if( j > i + 1 && j < n && p[j] == '}' ) {
+            if( i > 0 && p[i-1] == '\\' ) {
+                if( res.isEmpty() )
+                    res.reserve(n);
+                res.append(p + copied, i - 1 - copied); // drop the backslash
+                copied = i;
+            } else {
+                QHash<QString,QString>::ConstIterator it =
+                        dlookup.constFind(QString::fromRawData(p + i + 1, j - i - 1));
+                if( it != dlookup.constEnd() ) {
+                    if( res.isEmpty() )
+                        res.reserve(n + it.value().size());
+                    res.append(p + copied, i - copied);
+                    res += it.value();
+                    copied = j + 1;
+                }
+            }
+            i = j + 1;
+        } else
+            i = j;
+        i = i < n ? s.indexOf('{', i) : -1;
+    }
+    if( copied == 0 )
+        return s;
+    res.append(p + copied, n - copied);
+    return res;
 }
 
 void Preprocessor::substituteInlineList(QList<Node*>& inl)
@@ -109,6 +195,28 @@ void Preprocessor::substituteInlineList(QList<Node*>& inl)
     }
 }
 
+void Preprocessor::collectImages(const QList<Node*>& inl)
+{
+    // only the inline nodes; the blocks among the children are visited by processNode
+    for( int i = 0; i < inl.size(); ++i ) {
+        Node* n = inl[i];
+        if( !n || n->kind < Node::K_Text )
+            continue;
+        if( n->kind == Node::K_InlineMacro && n->atom == Atom::A_image ) {
+            const QString path = n->target.trimmed();
+            if( path.contains("://") )
+                continue; // not a file
+            const QString absPath = QFileInfo(path).isRelative() ? dbaseDir + "/" + path : path;
+            n->target = QFileInfo(absPath).absoluteFilePath();
+            if( QFileInfo(n->target).isFile() )
+                imageFiles.append(n->target);
+            else
+                error(n->pos.row, "image file not found: " + path);
+        } else if( !n->children.isEmpty() && n->kind != Node::K_InlineMacro )
+            collectImages(n->children);
+    }
+}
+
 bool Preprocessor::resolveInclude(Node* parent, int childIdx, int depth)
 {
     Node* inc = parent->children[childIdx];
@@ -145,7 +253,8 @@ bool Preprocessor::resolveInclude(Node* parent, int childIdx, int depth)
         return false;
     }
 
-    QString content = readFile(absPath);
+    QList<Utf8Decoder::Error> decodeErrors;
+    QString content = readFile(absPath, decodeErrors);
     if( content.isNull()) {
         error(inc->pos.row, "include file not found: " + path);
         // remove the include node, continue
@@ -153,6 +262,13 @@ bool Preprocessor::resolveInclude(Node* parent, int childIdx, int depth)
         Node::deleteTree(inc);
         return true;
     }
+    if( dcollectFiles )
+        includedFiles.append(QFileInfo(absPath).absoluteFilePath());
+    for( int i = 0; i < decodeErrors.size(); ++i)
+        error(inc->pos.row, "[" + path + ":" +
+              QString::number(decodeErrors[i].pos.row) + ":" +
+              QString::number(decodeErrors[i].pos.col) + "] " +
+              decodeErrors[i].message);
 
     // apply tag filter
     QStringList lines = content.split('\n');
@@ -177,7 +293,7 @@ bool Preprocessor::resolveInclude(Node* parent, int childIdx, int depth)
 
     // parse included content
     dincludeStack.insert(canonical);
-    Parser parser;
+    Parser parser(dparserOpt);
     Node* subdoc = parser.parse(content);
     dincludeStack.remove(canonical);
 
@@ -210,7 +326,7 @@ bool Preprocessor::resolveInclude(Node* parent, int childIdx, int depth)
         processNode(included[i], depth + 1);
     dbaseDir = oldBase;
 
-    delete subdoc->meta;
+    BlockMeta::release(subdoc->meta);
     delete subdoc;
     return true;
 }
@@ -218,7 +334,7 @@ bool Preprocessor::resolveInclude(Node* parent, int childIdx, int depth)
 bool Preprocessor::evaluateConditional(Node* parent, int childIdx)
 {
     Node* dir = parent->children[childIdx];
-    bool isIfdef = (dir->name == "ifdef");
+    bool isIfdef = (dir->atom == Atom::A_ifdef);
 
     // parse condition: "attr1,attr2[optional text]"
     QString raw = dir->text.trimmed();
@@ -248,7 +364,7 @@ bool Preprocessor::evaluateConditional(Node* parent, int childIdx)
         // remove the endif node from the body (last child if present)
         if( !body.isEmpty()) {
             Node* last = body.last();
-            if( last && last->kind == Node::K_Directive && last->name == "endif") {
+            if( last && last->kind == Node::K_Directive && last->atom == Atom::A_endif) {
                 body.removeLast();
                 Node::deleteTree(last);
             }
@@ -266,13 +382,16 @@ bool Preprocessor::evaluateConditional(Node* parent, int childIdx)
     return true;
 }
 
-QString Preprocessor::readFile(const QString& path)
+QString Preprocessor::readFile(const QString& path, QList<Utf8Decoder::Error>& decodeErrors)
 {
     QFile f(path);
     if( !f.open(QIODevice::ReadOnly))
         return QString(); // null string indicates error
     QByteArray bytes = f.readAll();
-    return QString::fromUtf8(bytes.constData(), bytes.size());
+    Utf8Decoder dec;
+    const QString text = dec.decode(bytes);
+    decodeErrors = dec.errors;
+    return text;
 }
 
 QStringList Preprocessor::filterByTag(const QStringList& lines, const QString& tag)
@@ -23,8 +23,11 @@
 #include <QtCore/QString>
 #include <QtCore/QStringList>
 #include <QtCore/QMap>
+#include <QtCore/QHash>
 #include <QtCore/QSet>
 #include "LeanDocAst2.h"
+#include "LeanDocParser2.h"
+#include "LeanDocUtf8.h"
 
 namespace LeanDoc {
 
@@ -37,14 +40,25 @@ struct PreprocessorError {
 
 class Preprocessor {
 public:
-    Preprocessor():dmaxIncludeDepth(8){}
+    Preprocessor():dlookupValid(false),dmaxIncludeDepth(8),dcollectFiles(false){}
 
     void setBaseDir(const QString& dir) { dbaseDir = dir; }
-    void setDefinedAttrs(const QMap<QString,QString>& attrs) { dattrs = attrs; }
+    void setDefinedAttrs(const QMap<QString,QString>& attrs) { dattrs = attrs; dlookupValid = false; }
+    void setParserOptions(const Parser::Options& opt) { dparserOpt = opt; } // for included files
+    // records the included files and the image files, and makes the image targets
+    // absolute, since the images of an included file are relative to its directory
+    void setCollectFiles(bool on) { dcollectFiles = on; }
 
     bool process(Node* doc);
 
+    // streaming: begin() with the document header, then processBlocks() whenever doc holds the
+    // next part of the top-level blocks; the errors accumulate until cleared by the caller
+    bool begin(Node* doc);
+    void processBlocks(Node* doc);
+
     QList<PreprocessorError> errors;
+    QStringList includedFiles; // absolute paths, in document order
+    QStringList imageFiles;
 
 private:
     void collectDocAttrs(Node* doc);
@@ -55,8 +69,11 @@ private:
     bool evaluateConditional(Node* parent, int childIdx);
     void substituteAttrRefs(Node* n);
     void substituteInlineList(QList<Node*>& inl);
+    void collectImages(const QList<Node*>& inl);
+    QString substituteInText(const QString& s);
+    static bool hasAttributeSubs(const Node* n);
 
-    QString readFile(const QString& path);
+    QString readFile(const QString& path, QList<Utf8Decoder::Error>& decodeErrors);
     QStringList filterByTag(const QStringList& lines, const QString& tag);
     QStringList filterByLines(const QStringList& lines, const QString& spec);
 
@@ -64,8 +81,12 @@ private:
 
     QString dbaseDir;
     QMap<QString,QString> dattrs;
+    QHash<QString,QString> dlookup; // dattrs for the scan of raw block bodies
+    bool dlookupValid;
     QSet<QString> dincludeStack; // circular include detection
     int dmaxIncludeDepth;
+    Parser::Options dparserOpt;
+    bool dcollectFiles;
 };
 
 } // namespace LeanDoc
@@ -0,0 +1,116 @@
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the LeanDoc document language project.
+*
+* The following is the license that applies to this copy of the
+* file. For a license to use the file under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "LeanDocReplacements.h"
+#include <string.h>
+using namespace LeanDoc;
+
+static const struct {
+    const char* pattern;
+    ushort replacement;
+} s_patterns[Replacements::MaxPattern] = {
+    { "(C)", 0x00A9 },
+    { "(R)", 0x00AE },
+    { "(TM)", 0x2122 },
+    { "...", 0x2026 },
+    { "->", 0x2192 },
+    { "=>", 0x21D2 },
+    { "<-", 0x2190 },
+    { "--", 0x2014 },
+};
+
+const Replacements& Replacements::instance()
+{
+    static const Replacements s_inst;
+    return s_inst;
+}
+
+int Replacements::length(int pattern)
+{
+    return ::strlen(s_patterns[pattern].pattern);
+}
+
+QChar Replacements::replacement(int pattern)
+{
+    return QChar(s_patterns[pattern].replacement);
+}
+
+bool Replacements::isAccepted(int pattern, QChar before, QChar after)
+{
+    if( pattern != EmDash )
+        return true;
+    const bool spaces = (before.isNull() || before.isSpace()) && (after.isNull() || after.isSpace());
+    return spaces || (before.isLetterOrNumber() && after.isLetterOrNumber());
+}
+
+Replacements::Replacements()
+{
+    // the columns of the table are the characters which occur in the patterns
+    ::memset(dclass, 0, sizeof(dclass));
+    dclasses = 1;
+    for( int p = 0; p < MaxPattern; ++p )
+        for( const char* c = s_patterns[p].pattern; *c; ++c )
+            if( dclass[uchar(*c)] == 0 )
+                dclass[uchar(*c)] = dclasses++;
+
+    // trie of the patterns
+    dnext.fill(-1, dclasses);
+    doutput.append(-1);
+    for( int p = 0; p < MaxPattern; ++p ) {
+        int state = 0;
+        for( const char* c = s_patterns[p].pattern; *c; ++c ) {
+            const int cls = dclass[uchar(*c)];
+            if( dnext[state * dclasses + cls] < 0 ) {
+                dnext[state * dclasses + cls] = doutput.size();
+                doutput.append(-1);
+                for( int k = 0; k < dclasses; ++k )
+                    dnext.append(-1);
+            }
+            state = dnext[state * dclasses + cls];
+        }
+        doutput[state] = p;
+    }
+
+    // breadth-first, so the failure state of a state is complete when it is needed; missing
+    // transitions are replaced by those of the failure state, which makes it a DFA
+    QVector<int> fail(doutput.size(), 0);
+    QVector<int> queue;
+    for( int cls = 0; cls < dclasses; ++cls ) {
+        int& t = dnext[cls];
+        if( t < 0 )
+            t = 0;
+        else if( t > 0 )
+            queue.append(t);
+    }
+    for( int q = 0; q < queue.size(); ++q ) {
+        const int state = queue[q];
+        if( doutput[state] < 0 )
+            doutput[state] = doutput[fail[state]];
+        for( int cls = 0; cls < dclasses; ++cls ) {
+            int& t = dnext[state * dclasses + cls];
+            const int viaFail = dnext[fail[state] * dclasses + cls];
+            if( t < 0 )
+                t = viaFail;
+            else {
+                fail[t] = viaFail;
+                queue.append(t);
+            }
+        }
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef LEANDOC_REPLACEMENTS_H
+#define LEANDOC_REPLACEMENTS_H
+
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the LeanDoc document language project.
+*
+* The following is the license that applies to this copy of the
+* file. For a license to use the file under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include <QtCore/QString>
+#include <QtCore/QVector>
+
+namespace LeanDoc {
+
+// The typographic text replacements of the spec, like (C) or ->, as an Aho-Corasick automaton
+// which is built once. The parser steps it with each character of plain text it accumulates,
+// so all patterns are found in one pass; a character which starts no pattern costs one table
+// lookup. Escaped characters and the content of monospace spans are never fed to it.
+class Replacements {
+public:
+    enum Pattern { Copyright, Registered, Trademark, Ellipsis, RightArrow, DoubleRightArrow,
+                   LeftArrow, EmDash, MaxPattern };
+
+    static const Replacements& instance();
+
+    // advances the state (0 initially) by c; returns the pattern which ends with c or -1
+    int step(int& state, QChar c) const
+    {
+        const ushort u = c.unicode();
+        const int cls = u < 128 ? dclass[u] : 0;
+        if( cls == 0 ) {
+            state = 0;
+            return -1;
+        }
+        state = dnext[state * dclasses + cls];
+        return doutput[state];
+    }
+
+    static int length(int pattern);
+    static QChar replacement(int pattern);
+    // the em dash is only replaced between spaces or between two word characters
+    static bool isAccepted(int pattern, QChar before, QChar after);
+
+private:
+    Replacements();
+    quint8 dclass[128]; // character -> column, 0: in no pattern
+    int dclasses;
+    QVector<int> dnext;   // state * dclasses + class -> state, the failure links are folded in
+    QVector<int> doutput; // state -> pattern or -1
+};
+
+} // namespace LeanDoc
+
+#endif
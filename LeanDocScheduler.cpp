@@ -0,0 +1,217 @@
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the LeanDoc document language project.
+*
+* The following is the license that applies to this copy of the
+* file. For a license to use the file under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "LeanDocScheduler.h"
+#include "LeanDocJobServer.h"
+#include <QtCore/QThread>
+#include <QtCore/QMutexLocker>
+using namespace LeanDoc;
+
+namespace LeanDoc {
+class SchedulerWorker : public QThread {
+public:
+    SchedulerWorker(Scheduler* s, int i):dsched(s),dindex(i){}
+protected:
+    void run() { dsched->workerLoop(dindex); }
+private:
+    Scheduler* dsched;
+    int dindex;
+};
+}
+
+static int s_defaultThreads = 0;
+static JobServer* s_defaultJobs = 0;
+
+Scheduler* Scheduler::instance()
+{
+    static Scheduler s(s_defaultThreads, s_defaultJobs);
+    return &s;
+}
+
+void Scheduler::setDefaultThreadCount(int n)
+{
+    s_defaultThreads = n;
+}
+
+void Scheduler::setDefaultJobServer(JobServer* js)
+{
+    s_defaultJobs = js;
+}
+
+Scheduler::Scheduler(int threads, JobServer* js):djobs(js),dthreads(threads),dquit(false)
+{
+    if( dthreads <= 0 )
+        dthreads = QThread::idealThreadCount();
+    if( dthreads < 1 )
+        dthreads = 1;
+    for( int i = 0; i < dthreads; ++i )
+        ddeques.append(new Deque());
+    for( int i = 0; i < dthreads - 1; ++i ) {
+        dworkers.append(new SchedulerWorker(this, i));
+        dworkers.last()->start();
+    }
+}
+
+Scheduler::~Scheduler()
+{
+    dlock.lock();
+    dquit = true;
+    dwork.wakeAll();
+    dlock.unlock();
+    for( int i = 0; i < dworkers.size(); ++i ) {
+        dworkers[i]->wait();
+        delete dworkers[i];
+    }
+    for( int i = 0; i < ddeques.size(); ++i ) {
+        qDeleteAll(ddeques[i]->tasks);
+        delete ddeques[i];
+    }
+}
+
+int Scheduler::currentIndex() const
+{
+    QThread* cur = QThread::currentThread();
+    for( int i = 0; i < dworkers.size(); ++i )
+        if( dworkers[i] == cur )
+            return i;
+    return dthreads - 1;
+}
+
+void Scheduler::push(Task* t)
+{
+    Deque* d = ddeques[currentIndex()];
+    d->lock.lock();
+    d->tasks.append(t);
+    d->lock.unlock();
+    dqueued.ref();
+    QMutexLocker lock(&dlock);
+    dwork.wakeOne();
+}
+
+Task* Scheduler::take(int self)
+{
+    // own deque from the back, then steal from the front of the others
+    for( int k = 0; k < dthreads; ++k ) {
+        Deque* d = ddeques[(self + k) % dthreads];
+        QMutexLocker lock(&d->lock);
+        if( d->tasks.isEmpty() )
+            continue;
+        Task* t = k == 0 ? d->tasks.takeLast() : d->tasks.takeFirst();
+        dqueued.deref();
+        return t;
+    }
+    return 0;
+}
+
+void Scheduler::execute(Task* t)
+{
+    TaskGroup* g = t->dgroup;
+    t->run();
+    delete t;
+    g->finished();
+}
+
+void Scheduler::workerLoop(int self)
+{
+    bool token = false;
+    for(;;) {
+        if( dqueued.loadAcquire() > 0 ) {
+            if( djobs && !token ) {
+                // the calling thread runs on the token make gave us; all others need their own
+                token = djobs->acquire(10);
+                if( !token ) {
+                    QMutexLocker lock(&dlock);
+                    if( dquit )
+                        return;
+                    continue;
+                }
+            }
+            Task* t = take(self);
+            if( t ) {
+                execute(t);
+                continue;
+            }
+        }
+        if( token ) {
+            // give the token back as soon as there is nothing left to do
+            djobs->release();
+            token = false;
+        }
+        QMutexLocker lock(&dlock);
+        while( dqueued.loadAcquire() == 0 && !dquit )
+            dwork.wait(&dlock);
+        if( dquit )
+            return;
+    }
+}
+
+TaskGroup::TaskGroup(Scheduler* s):dsched(s)
+{
+    if( dsched == 0 )
+        dsched = Scheduler::instance();
+}
+
+TaskGroup::~TaskGroup()
+{
+    wait();
+}
+
+bool TaskGroup::isSerial() const
+{
+    return dsched->isSerial();
+}
+
+void TaskGroup::spawn(Task* t)
+{
+    if( dsched->isSerial() ) {
+        t->run();
+        delete t;
+        return;
+    }
+    t->dgroup = this;
+    dpending.ref();
+    dsched->push(t);
+}
+
+void TaskGroup::finished()
+{
+    // the lock is held while signalling, so the group cannot be destroyed in between
+    QMutexLocker lock(&dlock);
+    if( !dpending.deref() )
+        ddone.wakeAll();
+}
+
+void TaskGroup::wait()
+{
+    if( dsched->isSerial() )
+        return;
+    const int self = dsched->currentIndex();
+    for(;;) {
+        Task* t = dsched->take(self);
+        if( t ) {
+            dsched->execute(t);
+            continue;
+        }
+        QMutexLocker lock(&dlock);
+        if( dpending.loadAcquire() == 0 )
+            return;
+        // the remaining tasks of this group are running on other threads
+        ddone.wait(&dlock);
+    }
+}
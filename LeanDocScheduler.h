@@ -0,0 +1,114 @@
+#ifndef LEANDOC_SCHEDULER_H
+#define LEANDOC_SCHEDULER_H
+
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the LeanDoc document language project.
+*
+* The following is the license that applies to this copy of the
+* file. For a license to use the file under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QWaitCondition>
+#include <QtCore/QAtomicInt>
+
+class QThread;
+
+namespace LeanDoc {
+
+class TaskGroup;
+class Scheduler;
+class JobServer;
+
+// Unit of work; results are written to a slot owned by the spawner (e.g. an index into
+// a preallocated list), so the outcome does not depend on the execution order.
+class Task {
+public:
+    Task():dgroup(0){}
+    virtual ~Task(){}
+    virtual void run() = 0;
+private:
+    friend class TaskGroup;
+    friend class Scheduler;
+    TaskGroup* dgroup;
+};
+
+// Tasks spawned into a group are awaited together; groups can be nested, i.e. a task may
+// open its own group. While waiting the thread runs queued tasks instead of blocking.
+class TaskGroup {
+public:
+    explicit TaskGroup(Scheduler* s = 0); // 0: Scheduler::instance()
+    ~TaskGroup(); // waits for the remaining tasks
+
+    void spawn(Task* t); // takes ownership; runs t immediately in serial mode
+    void wait();
+    bool isSerial() const;
+
+private:
+    friend class Scheduler;
+    void finished();
+
+    Scheduler* dsched;
+    QAtomicInt dpending;
+    QMutex dlock;
+    QWaitCondition ddone;
+};
+
+// Work-stealing scheduler shared by all passes. Each worker owns a deque which it uses
+// LIFO; idle workers steal FIFO from the others. Threads which are not workers (e.g. the
+// main thread) push to a shared queue and join in while waiting on a group, so the
+// calling thread counts as one of threadCount(). The workers start with the instance.
+class Scheduler {
+public:
+    static Scheduler* instance();
+    // 0: one thread per core, 1: serial mode (no threads, tasks run when spawned);
+    // must be called before the first use of instance()
+    static void setDefaultThreadCount(int n);
+    // with a jobserver each worker holds a make token while it runs tasks
+    static void setDefaultJobServer(JobServer* js);
+
+    explicit Scheduler(int threads = 0, JobServer* js = 0);
+    ~Scheduler();
+
+    int threadCount() const { return dthreads; }
+    bool isSerial() const { return dthreads <= 1; }
+
+private:
+    friend class TaskGroup;
+    friend class SchedulerWorker;
+    struct Deque {
+        QMutex lock;
+        QList<Task*> tasks;
+    };
+    int currentIndex() const;
+    void push(Task* t);
+    Task* take(int self);
+    void execute(Task* t);
+    void workerLoop(int self);
+
+    QList<Deque*> ddeques; // one per worker, the last one is shared by non-worker threads
+    QList<QThread*> dworkers;
+    QMutex dlock;
+    QWaitCondition dwork;
+    QAtomicInt dqueued;
+    JobServer* djobs;
+    int dthreads;
+    bool dquit;
+};
+
+} // namespace LeanDoc
+
+#endif
@@ -0,0 +1,100 @@
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the LeanDoc document language project.
+*
+* The following is the license that applies to this copy of the
+* file. For a license to use the file under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "LeanDocSnapshot.h"
+using namespace LeanDoc;
+
+Snapshot& Snapshot::operator=(const Snapshot& rhs)
+{
+    if( rhs.droot )
+        rhs.droot->retain();
+    Node::deleteTree(droot);
+    droot = rhs.droot;
+    return *this;
+}
+
+const Node* Snapshot::node(const Path& p) const
+{
+    const Node* n = droot;
+    for( int i = 0; i < p.size() && n; ++i )
+        n = p[i] >= 0 && p[i] < n->children.size() ? n->children[p[i]] : 0;
+    return n;
+}
+
+Node* Snapshot::copyPath(const Path& p, int len, QList<Node*>& copies) const
+{
+    // copies the root and the first len nodes of the path; returns the new root
+    if( droot == 0 || node(p.mid(0, len)) == 0 )
+        return 0;
+    Node* root = droot->shallowCopy();
+    copies.append(root);
+    Node* cur = root;
+    for( int i = 0; i < len; ++i ) {
+        Node* copy = cur->children[p[i]]->shallowCopy();
+        Node::deleteTree(cur->children[p[i]]); // drops the reference taken by shallowCopy
+        cur->children[p[i]] = copy;
+        copies.append(copy);
+        cur = copy;
+    }
+    return root;
+}
+
+Snapshot Snapshot::replaced(const Path& p, Node* n) const
+{
+    if( p.isEmpty() )
+        return Snapshot(n);
+    QList<Node*> copies;
+    Node* root = copyPath(p, p.size() - 1, copies);
+    if( root == 0 || p.last() < 0 || p.last() >= copies.last()->children.size() ) {
+        Node::deleteTree(root);
+        Node::deleteTree(n);
+        return Snapshot();
+    }
+    Node*& slot = copies.last()->children[p.last()];
+    Node::deleteTree(slot);
+    slot = n;
+    return Snapshot(root);
+}
+
+Snapshot Snapshot::inserted(const Path& parent, int index, Node* n) const
+{
+    QList<Node*> copies;
+    Node* root = copyPath(parent, parent.size(), copies);
+    if( root == 0 || index < 0 || index > copies.last()->children.size() ) {
+        Node::deleteTree(root);
+        Node::deleteTree(n);
+        return Snapshot();
+    }
+    copies.last()->children.insert(index, n);
+    return Snapshot(root);
+}
+
+Snapshot Snapshot::removed(const Path& p) const
+{
+    if( p.isEmpty() )
+        return Snapshot();
+    QList<Node*> copies;
+    Node* root = copyPath(p, p.size() - 1, copies);
+    if( root == 0 || p.last() < 0 || p.last() >= copies.last()->children.size() ) {
+        Node::deleteTree(root);
+        return Snapshot();
+    }
+    Node::deleteTree(copies.last()->children.takeAt(p.last()));
+    return Snapshot(root);
+}
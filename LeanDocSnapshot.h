@@ -0,0 +1,59 @@
+#ifndef LEANDOC_SNAPSHOT_H
+#define LEANDOC_SNAPSHOT_H
+
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the LeanDoc document language project.
+*
+* The following is the license that applies to this copy of the
+* file. For a license to use the file under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "LeanDocAst2.h"
+
+namespace LeanDoc {
+
+// An immutable version of a document. Edits return a new snapshot which copies only the
+// nodes on the path from the root to the change and shares all other subtrees with this one;
+// the nodes are reference counted, so both snapshots can be read (e.g. by the validator and
+// the generator on other threads) and destroyed independently.
+// The nodes reachable from a snapshot must not be modified; passes which work in place, like
+// the preprocessor, have to run before the tree is handed to the snapshot.
+class Snapshot {
+public:
+    typedef QList<int> Path; // child indices, starting at the root
+
+    Snapshot():droot(0){}
+    explicit Snapshot(Node* root):droot(root){} // takes over the reference
+    Snapshot(const Snapshot& rhs):droot(rhs.droot) { if( droot ) droot->retain(); }
+    Snapshot& operator=(const Snapshot& rhs);
+    ~Snapshot() { Node::deleteTree(droot); }
+
+    bool isNull() const { return droot == 0; }
+    const Node* root() const { return droot; }
+    const Node* node(const Path& p) const; // 0 if the path is invalid
+
+    // each takes over the reference of n; the result is null if the path is invalid
+    Snapshot replaced(const Path& p, Node* n) const;
+    Snapshot inserted(const Path& parent, int index, Node* n) const;
+    Snapshot removed(const Path& p) const;
+
+private:
+    Node* copyPath(const Path& p, int len, QList<Node*>& copies) const;
+    Node* droot;
+};
+
+} // namespace LeanDoc
+
+#endif
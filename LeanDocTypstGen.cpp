@@ -17,6 +17,9 @@
 * http://www.gnu.org/copyleft/gpl.html.
 */
 #include "LeanDocTypstGen.h"
+#include "LeanDocScheduler.h"
+#include "LeanDocAtoms.h"
+#include "LeanDocMacros.h"
 using namespace LeanDoc;
 
 static bool failAt(TypstGenError* err, const Node* n, const QString& msg)
@@ -28,6 +31,100 @@ static bool failAt(TypstGenError* err, const Node* n, const QString& msg)
     return false;
 }
 
+static bool emitFootnote(TypstGenerator* gen, const Node* n, QTextStream& out, TypstGenError* err)
+{
+    out << "#footnote[";
+    if( !gen->emitInlineSeq(n->children, out, err))
+        return false;
+    out << "]";
+    return true;
+}
+
+static bool emitKeys(TypstGenerator* gen, const Node* n, QTextStream& out, TypstGenError* err)
+{
+    out << "#smallcaps[";
+    if( !gen->emitInlineSeq(n->children, out, err))
+        return false;
+    out << "]";
+    return true;
+}
+
+static bool emitStem(TypstGenerator*, const Node* n, QTextStream& out, TypstGenError*)
+{
+    out << "$" << TypstGenerator::escText(n->target) << "$";
+    return true;
+}
+
+static bool emitLatexMath(TypstGenerator* gen, const Node* n, QTextStream& out, TypstGenError* err)
+{
+    return gen->emitMath(n, out, err, false);
+}
+
+static bool emitInclude(TypstGenerator*, const Node* n, QTextStream& out, TypstGenError*)
+{
+    // include should have been resolved by preprocessor; skip if unresolved
+    out << "// [unresolved include: " << TypstGenerator::escText(n->target) << "]\n";
+    return true;
+}
+
+static bool emitImageMacro(TypstGenerator* gen, const Node* n, QTextStream& out, TypstGenError*)
+{
+    // image is an inline macro only; an image which is the sole content of a paragraph is
+    // rendered as a block by emitParagraph
+    out << "#box(" << gen->imageCall(n) << ")";
+    return true;
+}
+
+static bool emitMedia(TypstGenerator*, const Node* n, QTextStream& out, TypstGenError*)
+{
+    out << "#link(\"" << TypstGenerator::escString(n->name + "::" + n->target.trimmed()) << "\")["
+        << TypstGenerator::escText(n->name.toUpper() + ": " + n->target.trimmed()) << "]\n";
+    return true;
+}
+
+static bool registerMacros()
+{
+    // the atoms are predefined, so the registry table does not move while it is read
+    MacroRegistry& r = MacroRegistry::instance();
+    r.setTypst(Atom::A_footnote, emitFootnote);
+    r.setTypst(Atom::A_kbd, emitKeys);
+    r.setTypst(Atom::A_btn, emitKeys);
+    r.setTypst(Atom::A_menu, emitKeys);
+    r.setTypst(Atom::A_stem, emitStem);
+    r.setTypst(Atom::A_latexmath, emitLatexMath);
+    r.setTypst(Atom::A_include, emitInclude);
+    r.setTypst(Atom::A_image, emitImageMacro);
+    r.setTypst(Atom::A_video, emitMedia);
+    r.setTypst(Atom::A_audio, emitMedia);
+    return true;
+}
+
+TypstGenerator::TypstGenerator(const Options& opt) : dopt(opt), dindex(0), dtitles(0), dmath(0), dimages(0)
+{
+    static const bool s_registered = registerMacros();
+    Q_UNUSED(s_registered);
+}
+
+bool TypstGenerator::fail(TypstGenError* err, const Node* n, const QString& msg)
+{
+    return failAt(err, n, msg);
+}
+
+QString TypstGenerator::imageCall(const Node* n) const
+{
+    // image:path[alt,width,height]; only the alt text is passed on, the sizes are pixels
+    QString path = n->target.trimmed();
+    if( dimages )
+        path = dimages->value(path, path);
+    QString alt;
+    if( !n->children.isEmpty() && n->children.first()->kind == Node::K_Text )
+        alt = n->children.first()->text.section(',', 0, 0).trimmed();
+    QString r = "image(\"" + escString(path) + "\"";
+    if( !alt.isEmpty() )
+        r += ", alt: \"" + escString(alt) + "\"";
+    return r + ")";
+}
+
 QString TypstGenerator::escString(const QString& s)
 {
     QString r;
@@ -81,7 +178,69 @@ QString TypstGenerator::headingMarks(int level)
     return QString(level, '=');
 }
 
+namespace LeanDoc {
+class EmitBlockTask : public Task {
+public:
+    struct Result {
+        QString text;
+        TypstGenError err;
+        bool ok;
+        Result():ok(true){}
+    };
+    EmitBlockTask(TypstGenerator* g, const Node* n, int shift, Result* out):dg(g),dn(n),dshift(shift),dout(out){}
+    void run()
+    {
+        QTextStream s(&dout->text);
+        dout->ok = dg->emitNode(dn, s, &dout->err, dshift);
+        s.flush();
+    }
+private:
+    TypstGenerator* dg;
+    const Node* dn;
+    int dshift;
+    Result* dout;
+};
+}
+
 bool TypstGenerator::generate(const Node* doc, QTextStream& out, TypstGenError* err)
+{
+    if( !generateHeader(doc, out, err))
+        return false;
+
+    const int shift = headingShift(doc);
+    if( dindex )
+        dindex->sorted(); // once, before the blocks are rendered concurrently
+    TaskGroup group;
+    if( group.isSerial() || doc->children.size() < 2 ) {
+        for( int i=0;i<doc->children.size();++i) {
+            if( !emitNode(doc->children[i], out, err, shift))
+                return false;
+            out << "\n";
+        }
+        return true;
+    }
+
+    // the top-level blocks are rendered concurrently into separate buffers which are then
+    // concatenated in document order; the first failing block determines the error
+    QList<EmitBlockTask::Result> parts;
+    for( int i=0;i<doc->children.size();++i)
+        parts.append(EmitBlockTask::Result());
+    for( int i=0;i<doc->children.size();++i)
+        group.spawn(new EmitBlockTask(this, doc->children[i], shift, &parts[i]));
+    group.wait();
+    for( int i=0;i<parts.size();++i) {
+        out << parts[i].text;
+        if( !parts[i].ok ) {
+            if( err )
+                *err = parts[i].err;
+            return false;
+        }
+        out << "\n";
+    }
+    return true;
+}
+
+bool TypstGenerator::generateHeader(const Node* doc, QTextStream& out, TypstGenError* err)
 {
     if( !doc || doc->kind != Node::K_Document)
         return failAt(err, doc, "Root node is not a Document");
@@ -99,17 +258,23 @@ bool TypstGenerator::generate(const Node* doc, QTextStream& out, TypstGenError*
     // emit TOC if :toc: attribute present
     if( doc->kv.contains("attr:toc"))
         out << "#outline(depth: 3)\n#pagebreak()\n\n";
+    return true;
+}
 
-    // shift heading levels: doc title is level 1 (extracted), body starts at level 2
-    int shift = doc->kv.contains("title") ? -1 : 0;
-    for( int i=0;i<doc->children.size();++i) {
-        if( !emitNode(doc->children[i], out, err, shift))
-            return false;
-        out << "\n";
-    }
+bool TypstGenerator::generateBlock(const Node* doc, const Node* block, QTextStream& out, TypstGenError* err)
+{
+    if( !emitNode(block, out, err, headingShift(doc)))
+        return false;
+    out << "\n";
     return true;
 }
 
+int TypstGenerator::headingShift(const Node* doc)
+{
+    // shift heading levels: doc title is level 1 (extracted), body starts at level 2
+    return doc->kv.contains("title") ? -1 : 0;
+}
+
 bool TypstGenerator::emitPreamble(const Node* doc, QTextStream& out, TypstGenError* err)
 {
     if( !dopt.templateFile.isEmpty()) {
@@ -205,17 +370,74 @@ bool TypstGenerator::emitSection(const Node* n, QTextStream& out, TypstGenError*
     } else {
         out << escText(n->name);
     }
-    out << labelSuffix(n->meta) << "\n\n";
+    out << labelSuffix(n->meta);
+    const QString id = dtitles ? dtitles->labelOf(n) : QString();
+    if( !id.isEmpty() )
+        out << " <" << id << ">";
+    out << "\n\n";
     for( int i=0;i<n->children.size();++i ) {
         if( !emitNode(n->children[i], out, err, headingShift))
             return false;
         out << "\n";
     }
+    if( dindex && n->meta && (n->meta->attrs().value(Atom::positional(0)) == "index" ||
+                              n->meta->roles().contains("index")) )
+        emitIndex(out);
     return true;
 }
 
+void TypstGenerator::emitIndex(QTextStream& out)
+{
+    // grouped by initial; an entry only repeats the terms which differ from the previous one
+    const QList<const Index::Entry*> l = dindex->sorted();
+    QChar initial;
+    QStringList prev;
+    for( int i = 0; i < l.size(); ++i ) {
+        const Index::Entry* e = l[i];
+        const QChar c = e->key.isEmpty() ? QChar() : e->key[0].toUpper();
+        if( c != initial ) {
+            initial = c;
+            prev.clear();
+            out << "\n#strong[" << escText(QString(c)) << "] \\\n";
+        }
+        int common = 0;
+        while( common < prev.size() && common < e->terms.size() - 1 && prev[common] == e->terms[common] )
+            common++;
+        for( int t = common; t < e->terms.size(); ++t ) {
+            for( int k = 0; k < t; ++k )
+                out << "#h(1.5em)";
+            out << escText(e->terms[t]);
+            if( t == e->terms.size() - 1 )
+                for( int r = 0; r < e->refs.size(); ++r )
+                    out << ", #link(<" << e->refs[r].label << ">)[#context locate(<"
+                        << e->refs[r].label << ">).page()]";
+            out << " \\\n";
+        }
+        prev = e->terms;
+    }
+}
+
 bool TypstGenerator::emitParagraph(const Node* n, QTextStream& out, TypstGenError* err)
 {
+    if( n->children.size() == 1 && n->children[0]->kind == Node::K_InlineMacro &&
+            n->children[0]->atom == Atom::A_latexmath ) {
+        // a block-level equation
+        if( !emitMath(n->children[0], out, err, true) )
+            return false;
+        out << labelSuffix(n->meta) << "\n";
+        return true;
+    }
+    if( n->children.size() == 1 && n->children[0]->kind == Node::K_InlineMacro &&
+            n->children[0]->atom == Atom::A_image ) {
+        // a block-level image, a figure if it has a title
+        if( n->meta && !n->meta->title.isEmpty() )
+            out << "#figure(" << imageCall(n->children[0]) << ", caption: ["
+                << escText(n->meta->title) << "])";
+        else
+            out << "#" << imageCall(n->children[0]);
+        out << labelSuffix(n->meta) << "\n";
+        return true;
+    }
     if( !emitInlineSeq(n->children, out, err))
         return false;
     out << labelSuffix(n->meta) << "\n";
@@ -301,11 +523,11 @@ bool TypstGenerator::emitList(const Node* n, QTextStream& out, TypstGenError* er
 
 static QString typstColSpec(const BlockMeta* m, int fallbackCols)
 {
-    if( !m || !m->attrs.contains("cols"))
+    if( !m || !m->attrs().contains(Atom::A_cols))
         return QString::number(fallbackCols);
 
     // parse cols="1,2,3" into (1fr, 2fr, 3fr)
-    QString v = m->attrs.value("cols");
+    QString v = m->attrs().value(Atom::A_cols);
     if( v.startsWith('"') && v.endsWith('"'))
         v = v.mid(1, v.size()-2);
     const QStringList parts = v.split(',');
@@ -344,9 +566,9 @@ bool TypstGenerator::emitTable(const Node* n, QTextStream& out, TypstGenError* e
     if( cols <= 0)
         return true;
 
-    const bool hasHeader = n->kv.contains("header") ||
-        (n->meta && n->meta->attrs.contains("options") &&
-         n->meta->attrs.value("options").contains("header"));
+    const bool hasHeader = n->kv.contains(Atom::A_header) ||
+        (n->meta && n->meta->attrs().contains(Atom::A_options) &&
+         n->meta->attrs().value(Atom::A_options).contains("header"));
 
     out << "#table(columns: " << typstColSpec(n->meta, cols) << ",\n";
     if( hasHeader)
@@ -375,26 +597,9 @@ bool TypstGenerator::emitTable(const Node* n, QTextStream& out, TypstGenError* e
 
 bool TypstGenerator::emitBlockMacro(const Node* n, QTextStream& out, TypstGenError* err)
 {
-    if( n->name == "include") {
-        // include should have been resolved by preprocessor; skip if unresolved
-        out << "// [unresolved include: " << escText(n->target) << "]\n";
-        return true;
-    }
-
-    if( n->name == "image") {
-        QString t = n->target.trimmed();
-        int lb = t.indexOf('[');
-        QString path = (lb < 0) ? t : t.left(lb).trimmed();
-        out << "#image(\"" << escString(path) << "\")" << labelSuffix(n->meta) << "\n";
-        return true;
-    }
-
-    if( n->name == "video" || n->name == "audio") {
-        out << "#link(\"" << escString(n->name + "::" + n->target.trimmed()) << "\")["
-            << escText(n->name.toUpper() + ": " + n->target.trimmed()) << "]\n";
-        return true;
-    }
-
+    const MacroRegistry::Macro* m = MacroRegistry::instance().find(n->atom);
+    if( m && m->typst )
+        return m->typst(this, n, out, err);
     return failAt(err, n, "Unsupported block macro in Typst generator: " + n->name);
 }
 
@@ -408,6 +613,20 @@ bool TypstGenerator::emitDirective(const Node* n, QTextStream& out, TypstGenErro
     return true;
 }
 
+bool TypstGenerator::emitMath(const Node* n, QTextStream& out, TypstGenError* err, bool display)
+{
+    QString typst, msg;
+    const bool ok = dmath ? dmath->translate(n->text, typst, &msg) :
+                            LatexMath::translate(n->text, typst, &msg);
+    if( !ok )
+        return failAt(err, n, "latexmath: " + msg);
+    if( display )
+        out << "$ " << typst << " $";
+    else
+        out << "$" << typst << "$";
+    return true;
+}
+
 bool TypstGenerator::emitInlineSeq(const QList<Node*>& inl, QTextStream& out, TypstGenError* err)
 {
     for( int i=0;i<inl.size();++i) {
@@ -477,21 +696,30 @@ bool TypstGenerator::emitInline(const Node* n, QTextStream& out, TypstGenError*
         }
         return true;
 
-    case Node::K_Xref:
+    case Node::K_Xref: {
+        const QString id = dtitles ? dtitles->linkTarget(n->target.trimmed()) : n->target;
         if( n->children.isEmpty()) {
-            out << "#link(<" << n->target << ">)[" << escText(n->target) << "]";
+            out << "#link(<" << id << ">)[" << escText(n->target) << "]";
         } else {
-            out << "#link(<" << n->target << ">)[";
+            out << "#link(<" << id << ">)[";
             if( !emitInlineSeq(n->children, out, err))
                 return false;
             out << "]";
         }
         return true;
+    }
 
     case Node::K_AnchorInline:
         out << "#metadata(none) <" << n->name << ">";
         return true;
 
+    case Node::K_IndexTerm:
+        if( !emitInlineSeq(n->children, out, err))
+            return false;
+        if( !n->target.isEmpty() )
+            out << "#metadata(none) <" << n->target << ">";
+        return true;
+
     case Node::K_AttrRef:
         out << "{" << escText(n->name) << "}";
         return true;
@@ -500,26 +728,12 @@ bool TypstGenerator::emitInline(const Node* n, QTextStream& out, TypstGenError*
         out << " \\\n";
         return true;
 
-    case Node::K_InlineMacro:
-        if( n->name == "footnote") {
-            out << "#footnote[";
-            if( !emitInlineSeq(n->children, out, err))
-                return false;
-            out << "]";
-            return true;
-        }
-        if( n->name == "kbd" || n->name == "btn" || n->name == "menu") {
-            out << "#smallcaps[";
-            if( !emitInlineSeq(n->children, out, err))
-                return false;
-            out << "]";
-            return true;
-        }
-        if( n->name == "stem") {
-            out << "$" << escText(n->target) << "$";
-            return true;
-        }
+    case Node::K_InlineMacro: {
+        const MacroRegistry::Macro* m = MacroRegistry::instance().find(n->atom);
+        if( m && m->typst )
+            return m->typst(this, n, out, err);
         return failAt(err, n, "Unsupported inline macro in Typst generator: " + n->name);
+    }
 
     default:
         return failAt(err, n, "Unsupported inline node kind in generator");
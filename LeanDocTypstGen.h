@@ -23,8 +23,11 @@
 #include <QtCore/QString>
 #include <QtCore/QTextStream>
 #include <QtCore/QFile>
+#include <QtCore/QHash>
 
 #include "LeanDocAst2.h"
+#include "LeanDocIndex.h"
+#include "LeanDocMath.h"
 
 namespace LeanDoc {
 
@@ -43,11 +46,37 @@ public:
         Options() : templateName("plain"), allowRawPassthrough(true) {}
     };
 
-    explicit TypstGenerator(const Options& opt) : dopt(opt) {}
+    explicit TypstGenerator(const Options& opt);
+
+    // the index is rendered into sections with the style or role "index"; the K_IndexTerm
+    // nodes must have been collected into it
+    void setIndex(Index* idx) { dindex = idx; }
+    // resolves cross-references to section titles and labels the sections they refer to
+    void setTitles(const TitleIndex* t) { dtitles = t; }
+    // memoizes the latexmath translations, also across documents; without each is translated
+    void setMathCache(MathCache* c) { dmath = c; }
+    // maps the image targets, e.g. to the copies in the asset directory; the targets which
+    // are not in the map are used as written
+    void setImagePaths(const QHash<QString,QString>* p) { dimages = p; }
 
     bool generate(const Node* doc, QTextStream& out, TypstGenError* err);
 
+    // streaming: the preamble, title and TOC from the document header, then each top-level
+    // block in order; together the same output as generate()
+    bool generateHeader(const Node* doc, QTextStream& out, TypstGenError* err);
+    bool generateBlock(const Node* doc, const Node* block, QTextStream& out, TypstGenError* err);
+
+    // for the macro handlers, see MacroRegistry
+    bool emitInlineSeq(const QList<Node*>& inl, QTextStream& out, TypstGenError* err);
+    bool emitMath(const Node* n, QTextStream& out, TypstGenError* err, bool display);
+    static QString escText(const QString& s);      // escape plain text in typst markup context
+    static QString escString(const QString& s);    // escape for "..." string literals
+    static QString labelSuffix(const BlockMeta* m);
+    static bool fail(TypstGenError* err, const Node* n, const QString& msg);
+    QString imageCall(const Node* n) const; // image("path", alt: "...") of an image macro
+
 private:
+    friend class EmitBlockTask;
     // top-level
     bool emitPreamble(const Node* doc, QTextStream& out, TypstGenError* err);
     bool emitNode(const Node* n, QTextStream& out, TypstGenError* err, int headingShift);
@@ -62,18 +91,20 @@ private:
     bool emitTable(const Node* n, QTextStream& out, TypstGenError* err);
     bool emitBlockMacro(const Node* n, QTextStream& out, TypstGenError* err);
     bool emitDirective(const Node* n, QTextStream& out, TypstGenError* err);
+    void emitIndex(QTextStream& out);
 
     // inline
-    bool emitInlineSeq(const QList<Node*>& inl, QTextStream& out, TypstGenError* err);
     bool emitInline(const Node* n, QTextStream& out, TypstGenError* err);
 
     // helpers
-    static QString escText(const QString& s);      // escape plain text in typst markup context
-    static QString escString(const QString& s);    // escape for "..." string literals
-    static QString labelSuffix(const BlockMeta* m);
     static QString headingMarks(int level);
+    static int headingShift(const Node* doc);
 
     Options dopt;
+    Index* dindex;
+    const TitleIndex* dtitles;
+    MathCache* dmath;
+    const QHash<QString,QString>* dimages;
 };
 
 } // namespace LeanDoc
@@ -0,0 +1,189 @@
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the LeanDoc document language project.
+*
+* The following is the license that applies to this copy of the
+* file. For a license to use the file under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "LeanDocUtf8.h"
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+using namespace LeanDoc;
+
+static QString runMessage(const uchar* bad, int len)
+{
+    QString msg = "invalid UTF-8 sequence";
+    const int shown = len > 8 ? 8 : len;
+    for( int i = 0; i < shown; ++i)
+        msg += QString(" 0x%1").arg(QString::number(bad[i], 16).toUpper().rightJustified(2, '0'));
+    if( shown < len)
+        msg += " ... (" + QString::number(len) + " bytes)";
+    return msg + " replaced by U+FFFD";
+}
+
+void Utf8Decoder::error(const ushort* out, int outIdx, const uchar* bad, int badLen)
+{
+    if( drunStart && drunStart + drunLen == bad && !errors.isEmpty()) {
+        drunLen += badLen;
+        errors.last().message = runMessage(drunStart, drunLen);
+        return;
+    }
+
+    // errors are rare, so line/column are only computed here; the output is scanned
+    // incrementally from the previous error on, which keeps the total cost linear
+    for( ; dscanned < outIdx; ++dscanned) {
+        if( out[dscanned] == '\n') {
+            ++dline;
+            dlineStart = dscanned + 1;
+        }
+    }
+    int col = 1;
+    for( int i = dlineStart; i < outIdx; ++i)
+        if( !QChar::isLowSurrogate(out[i]))
+            ++col;
+    const int maxCol = (1 << RowCol::COL_BIT_LEN) - 1;
+    if( col > maxCol)
+        col = maxCol;
+
+    errors.append(Error(runMessage(bad, badLen), dline, col));
+    drunStart = bad;
+    drunLen = badLen;
+}
+
+QString Utf8Decoder::decode(const char* data, int len)
+{
+    errors.clear();
+    dline = 1;
+    dscanned = 0;
+    dlineStart = 0;
+    drunStart = 0;
+    drunLen = 0;
+
+    if( data == 0 || len <= 0)
+        return QString("");
+
+    const uchar* s = reinterpret_cast<const uchar*>(data);
+    const uchar* const end = s + len;
+    if( len >= 3 && s[0] == 0xEF && s[1] == 0xBB && s[2] == 0xBF)
+        s += 3;
+
+    // every input byte yields at most one UTF-16 unit (4-byte sequences yield two)
+    QString res;
+    res.resize(int(end - s));
+    ushort* const out = reinterpret_cast<ushort*>(res.data());
+    ushort* dst = out;
+
+    while( s < end ) {
+        // ASCII fast path: widen whole blocks which contain neither non-ASCII bytes nor CR
+#if defined(__SSE2__)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i cr = _mm_set1_epi8('\r');
+            while( end - s >= 16 ) {
+                const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+                if( _mm_movemask_epi8(v) | _mm_movemask_epi8(_mm_cmpeq_epi8(v, cr)))
+                    break;
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_unpacklo_epi8(v, zero));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 8), _mm_unpackhi_epi8(v, zero));
+                s += 16;
+                dst += 16;
+            }
+        }
+#endif
+        while( end - s >= 8 ) {
+            quint64 w;
+            memcpy(&w, s, 8);
+            const quint64 hi = Q_UINT64_C(0x8080808080808080);
+            const quint64 x = w ^ Q_UINT64_C(0x0D0D0D0D0D0D0D0D); // a zero byte in x marks a CR
+            if( (w & hi) || ((x - Q_UINT64_C(0x0101010101010101)) & ~x & hi))
+                break;
+            for( int k = 0; k < 8; ++k)
+                dst[k] = s[k];
+            s += 8;
+            dst += 8;
+        }
+        if( s >= end )
+            break;
+
+        const uchar c = *s;
+        if( c < 0x80 ) {
+            if( c == '\r' ) {
+                *dst++ = '\n';
+                ++s;
+                if( s < end && *s == '\n' )
+                    ++s;
+            } else {
+                *dst++ = c;
+                ++s;
+            }
+            continue;
+        }
+
+        // multi-byte sequence; the ranges of the second byte exclude overlong forms,
+        // UTF-16 surrogates and code points above U+10FFFF (RFC 3629, table 3-7 of Unicode)
+        int need = 0;
+        uint cp = 0;
+        uchar lo = 0x80, hi = 0xBF;
+        if( c >= 0xC2 && c <= 0xDF ) {
+            need = 1;
+            cp = c & 0x1F;
+        } else if( c >= 0xE0 && c <= 0xEF ) {
+            need = 2;
+            cp = c & 0x0F;
+            if( c == 0xE0 )
+                lo = 0xA0;
+            else if( c == 0xED )
+                hi = 0x9F;
+        } else if( c >= 0xF0 && c <= 0xF4 ) {
+            need = 3;
+            cp = c & 0x07;
+            if( c == 0xF0 )
+                lo = 0x90;
+            else if( c == 0xF4 )
+                hi = 0x8F;
+        }
+
+        int k = 1;
+        if( need > 0 ) {
+            for( ; k <= need; ++k ) {
+                if( s + k >= end )
+                    break;
+                const uchar b = s[k];
+                if( b < (k == 1 ? lo : 0x80) || b > (k == 1 ? hi : 0xBF) )
+                    break;
+                cp = (cp << 6) | (b & 0x3F);
+            }
+        }
+        if( need == 0 || k <= need ) {
+            // replace the maximal invalid subpart by a single U+FFFD
+            error(out, int(dst - out), s, k);
+            *dst++ = QChar::ReplacementCharacter;
+            s += k;
+            continue;
+        }
+
+        if( cp >= 0x10000 ) {
+            *dst++ = QChar::highSurrogate(cp);
+            *dst++ = QChar::lowSurrogate(cp);
+        } else
+            *dst++ = ushort(cp);
+        s += need + 1;
+    }
+
+    res.resize(int(dst - out));
+    return res;
+}
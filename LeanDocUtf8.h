@@ -0,0 +1,61 @@
+#ifndef LEANDOC_UTF8_H
+#define LEANDOC_UTF8_H
+
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the LeanDoc document language project.
+*
+* The following is the license that applies to this copy of the
+* file. For a license to use the file under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include <QtCore/QString>
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+#include "LeanDocAst2.h"
+
+namespace LeanDoc {
+
+// Validating UTF-8 decoder used for all source input. In one pass over the bytes it
+// strips a leading BOM, normalizes CRLF and lone CR to LF, and replaces each invalid
+// sequence by U+FFFD. Unlike QString::fromUtf8 every replacement is reported with the
+// line and column (in characters) where it appears in the decoded text.
+class Utf8Decoder {
+public:
+    Utf8Decoder():dline(1),dscanned(0),dlineStart(0),drunStart(0),drunLen(0){}
+
+    QString decode(const QByteArray& bytes) { return decode(bytes.constData(), bytes.size()); }
+    QString decode(const char* data, int len);
+
+    struct Error {
+        RowCol pos;
+        QString message;
+        Error(){}
+        Error(const QString& m, int l, int c):pos(l,c),message(m){}
+    };
+    QList<Error> errors;
+
+private:
+    void error(const ushort* out, int outIdx, const uchar* bad, int badLen);
+
+    int dline;       // line number at index dscanned of the output
+    int dscanned;    // output prefix already scanned for line breaks
+    int dlineStart;  // output index where line dline starts
+    const uchar* drunStart; // adjacent invalid bytes are reported as one run
+    int drunLen;
+};
+
+} // namespace LeanDoc
+
+#endif
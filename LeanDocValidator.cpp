@@ -18,6 +18,9 @@
 */
 
 #include "LeanDocValidator.h"
+#include "LeanDocScheduler.h"
+#include "LeanDocIndex.h"
+#include <QtCore/QMutexLocker>
 using namespace LeanDoc;
 
 static bool isValidIdentifier(const QString& s)
@@ -44,112 +47,264 @@ static int parseColsCount(const QString& raw)
     return v.split(',').size();
 }
 
+static int firstLine(const Node* n)
+{
+    return n->metaRow > 0 && n->metaRow < int(n->pos.row) ? n->metaRow : int(n->pos.row);
+}
+
+namespace LeanDoc {
+// lets the sink stream the diagnostics up to the first top-level block not yet checked
+struct CheckProgress {
+    QMutex lock;
+    QList<bool> done;
+    int next;
+    const Node* doc;
+    DiagnosticSink* sink;
+    CheckProgress(const Node* d, DiagnosticSink* s):next(0),doc(d),sink(s)
+    {
+        for( int i = 0; i < doc->children.size(); ++i )
+            done.append(false);
+    }
+    void blockDone(int i)
+    {
+        QMutexLocker l(&lock);
+        done[i] = true;
+        while( next < done.size() && done[next] )
+            next++;
+        if( next < done.size() )
+            sink->setProgress(Diagnostic::Validate, firstLine(doc->children[next]));
+    }
+};
+
+class CheckBlockTask : public Task {
+public:
+    CheckBlockTask(const Validator* v, int i, QList<Diagnostic>* out, CheckProgress* p):
+        dv(v),di(i),dout(out),dprogress(p){}
+    void run()
+    {
+        DiagnosticSink* sink = dv->dsink;
+        if( sink == 0 || !sink->aborted() ) {
+            Validator sub;
+            sub.danchors = dv->danchors;
+            sub.dtitles = dv->dtitles;
+            sub.checkNode(dprogress->doc->children[di]);
+            *dout = sub.diagnostics;
+        }
+        if( sink ) {
+            DiagnosticSink::Buffer buf(sink, di);
+            for( int i = 0; i < dout->size(); ++i )
+                buf.report(dout->at(i));
+            buf.flush();
+            dprogress->blockDone(di);
+        }
+    }
+private:
+    const Validator* dv;
+    int di;
+    QList<Diagnostic>* dout;
+    CheckProgress* dprogress;
+};
+}
+
 void Validator::validate(const Node* doc)
 {
     diagnostics.clear();
     danchors.clear();
     danchorLines.clear();
 
-    if( !doc || doc->kind != Node::K_Document)
+    if( !doc || doc->kind != Node::K_Document) {
+        if( dsink )
+            dsink->endPhase(Diagnostic::Validate);
         return;
+    }
 
     collectAnchors(doc);
+    if( dsink )
+        for( int i = 0; i < diagnostics.size(); ++i )
+            dsink->report(diagnostics[i]);
+
+    // check attributes, references, context, etc.; the top-level blocks are independent once
+    // the anchors are known, so each is checked by its own task and the results are appended
+    // in document order
+    TaskGroup group;
+    if( group.isSerial() || doc->children.size() < 2 ) {
+        const int first = diagnostics.size();
+        checkNode(doc);
+        if( dsink ) {
+            for( int i = first; i < diagnostics.size(); ++i )
+                dsink->report(diagnostics[i]);
+            dsink->endPhase(Diagnostic::Validate);
+        }
+        return;
+    }
 
-    // check attributes, references, context, etc.
-    checkNode(doc);
+    // the document title precedes all blocks, so it is checked first to not hold back streaming
+    Validator title;
+    title.danchors = danchors;
+    title.dtitles = dtitles;
+    for( int i = 0; i < doc->titleChildren.size(); ++i )
+        title.checkNode(doc->titleChildren[i]);
+    if( dsink )
+        for( int i = 0; i < title.diagnostics.size(); ++i )
+            dsink->report(title.diagnostics[i]);
+
+    CheckProgress progress(doc, dsink);
+    QList< QList<Diagnostic> > results;
+    for( int i = 0; i < doc->children.size(); ++i )
+        results.append(QList<Diagnostic>());
+    for( int i = 0; i < doc->children.size(); ++i )
+        group.spawn(new CheckBlockTask(this, i, &results[i], &progress));
+    group.wait();
+    for( int i = 0; i < results.size(); ++i )
+        diagnostics += results[i];
+    diagnostics += title.diagnostics;
+    if( dsink )
+        dsink->endPhase(Diagnostic::Validate);
 }
 
-void Validator::collectAnchors(const Node* n)
+void Validator::begin(const Node* doc)
 {
-    if( !n )
+    diagnostics.clear();
+    danchors.clear();
+    danchorLines.clear();
+    dpendingXrefs.clear();
+    dstreaming = true;
+    if( !doc )
         return;
+    collectAnchors(doc);
+    for( int i = 0; i < doc->titleChildren.size(); ++i )
+        checkNode(doc->titleChildren[i]);
+    report(0);
+}
 
-    // explicit block anchor from metadata
-    if( n->meta && !n->meta->anchorId.isEmpty()) {
-        const QString& id = n->meta->anchorId;
-        const int line = n->meta->pos.row;
-
-        if( !isValidIdentifier(id))
-            error(line, "invalid anchor ID '[[" + id +
-                  "]]'; must match IDENTIFIER (start with letter/underscore, "
-                  "then letters/digits/underscore/hyphen)");
-
-        if( danchors.contains(id))
-            error(line, "duplicate anchor ID '[[" + id +
-                  "]]' (first declared at line " +
-                  QString::number(danchorLines.value(id)) + ")");
-        else {
-            danchors.insert(id);
-            danchorLines.insert(id, line);
-        }
+void Validator::validateBlock(const Node* block)
+{
+    // the blocks before are checked, except for the cross-references to come later
+    if( dsink ) {
+        const int line = firstLine(block);
+        dsink->setProgress(Diagnostic::Validate, dpendingXrefs.isEmpty() ? line :
+                                                 qMin(line, dpendingXrefs.first().line));
     }
+    diagnostics.clear();
+    collectAnchors(block);
+    checkNode(block);
+    report(0);
+}
 
-    // inline anchor (stored in name field)
-    if( n->kind == Node::K_AnchorInline && !n->name.isEmpty()) {
-        const QString& id = n->name;
-        const int line = n->pos.row;
-
-        if( !isValidIdentifier(id))
-            error(line, "invalid inline anchor ID '" + id +
-                  "'; must match IDENTIFIER");
-
-        if( danchors.contains(id))
-            error(line, "duplicate anchor ID '" + id +
-                  "' (first declared at line " +
-                  QString::number(danchorLines.value(id)) + ")");
-        else {
-            danchors.insert(id);
-            danchorLines.insert(id, line);
-        }
-    }
+void Validator::end()
+{
+    diagnostics.clear();
+    for( int i = 0; i < dpendingXrefs.size(); ++i )
+        if( !resolves(dpendingXrefs[i].id) )
+            // the link is already written
+            error(dpendingXrefs[i].line, "unresolved cross-reference '<<" + dpendingXrefs[i].id + ">>'");
+    dpendingXrefs.clear();
+    dstreaming = false;
+    report(0);
+    if( dsink )
+        dsink->endPhase(Diagnostic::Validate);
+}
 
-    for( int i = 0; i < n->children.size(); ++i)
-        collectAnchors(n->children[i]);
+void Validator::report(int first)
+{
+    if( dsink )
+        for( int i = first; i < diagnostics.size(); ++i )
+            dsink->report(diagnostics[i]);
 }
 
-void Validator::checkNode(const Node* n)
+void Validator::collectAnchors(const Node* root)
 {
-    if( !n )
-        return;
+    TreeIterator it(root);
+    while( const Node* n = it.next() ) {
+        // explicit block anchor from metadata
+        if( n->meta && !n->meta->anchorId.isEmpty()) {
+            const QString& id = n->meta->anchorId;
+            const int line = n->meta->pos.row;
+
+            if( !isValidIdentifier(id))
+                error(line, "invalid anchor ID '[[" + id +
+                      "]]'; must match IDENTIFIER (start with letter/underscore, "
+                      "then letters/digits/underscore/hyphen)");
+
+            if( danchors.contains(id))
+                error(line, "duplicate anchor ID '[[" + id +
+                      "]]' (first declared at line " +
+                      QString::number(danchorLines.value(id)) + ")");
+            else {
+                danchors.insert(id);
+                danchorLines.insert(id, line);
+            }
+            checkStreamedLabel(line, id);
+        }
 
-    switch( n->kind ) {
-    case Node::K_Table:
-        checkTableAttrs(n);
-        checkTableCellCount(n);
-        break;
-    case Node::K_Xref:
-        checkXref(n);
-        break;
-    case Node::K_DelimitedBlock:
-        checkBlockAttrs(n);
-        checkSourceAttrContext(n);
-        checkAdmonitionAttrContext(n);
-        break;
-    case Node::K_List:
-        checkBlockAttrs(n);
-        checkColsOnNonTable(n);
-        break;
-    case Node::K_Paragraph:
-        checkBlockAttrs(n);
-        checkColsOnNonTable(n);
-        break;
-    case Node::K_Section:
-        checkBlockAttrs(n);
-        checkRoleContext(n);
-        checkColsOnNonTable(n);
-        break;
-    case Node::K_AdmonitionParagraph:
-        checkBlockAttrs(n);
-        checkColsOnNonTable(n);
-        break;
-    default:
-        break;
+        // inline anchor (stored in name field)
+        if( n->kind == Node::K_AnchorInline && !n->name.isEmpty()) {
+            const QString& id = n->name;
+            const int line = n->pos.row;
+
+            if( !isValidIdentifier(id))
+                error(line, "invalid inline anchor ID '" + id +
+                      "'; must match IDENTIFIER");
+
+            if( danchors.contains(id))
+                error(line, "duplicate anchor ID '" + id +
+                      "' (first declared at line " +
+                      QString::number(danchorLines.value(id)) + ")");
+            else {
+                danchors.insert(id);
+                danchorLines.insert(id, line);
+            }
+            checkStreamedLabel(line, id);
+        }
     }
+}
 
-    for( int i = 0; i < n->children.size(); ++i )
-        checkNode(n->children[i]);
-    for( int i = 0; i < n->titleChildren.size(); ++i )
-        checkNode(n->titleChildren[i]);
+void Validator::checkStreamedLabel(int line, const QString& id)
+{
+    // the other way round the section would get another ID, but it is already written
+    if( dstreaming && dtitles && dtitles->isAutoId(id) )
+        error(line, "anchor ID '" + id + "' is the label of an earlier section without anchor, "
+              "which cannot be changed when streaming; give that section an explicit anchor");
+}
+
+void Validator::checkNode(const Node* root)
+{
+    TreeIterator it(root, TreeIterator::WithTitles);
+    while( const Node* n = it.next() ) {
+        switch( n->kind ) {
+        case Node::K_Table:
+            checkTableAttrs(n);
+            checkTableCellCount(n);
+            break;
+        case Node::K_Xref:
+            checkXref(n);
+            break;
+        case Node::K_DelimitedBlock:
+            checkBlockAttrs(n);
+            checkSourceAttrContext(n);
+            checkAdmonitionAttrContext(n);
+            break;
+        case Node::K_List:
+            checkBlockAttrs(n);
+            checkColsOnNonTable(n);
+            break;
+        case Node::K_Paragraph:
+            checkBlockAttrs(n);
+            checkColsOnNonTable(n);
+            break;
+        case Node::K_Section:
+            checkBlockAttrs(n);
+            checkRoleContext(n);
+            checkColsOnNonTable(n);
+            break;
+        case Node::K_AdmonitionParagraph:
+            checkBlockAttrs(n);
+            checkColsOnNonTable(n);
+            break;
+        default:
+            break;
+        }
+    }
 }
 
 static bool isValidColSpec(const QString& raw)
@@ -201,19 +356,20 @@ void Validator::checkTableAttrs(const Node* n)
     if( !n->meta )
         return;
 
-    const QMap<QString, QString>& a = n->meta->attrs;
-    for( QMap<QString, QString>::ConstIterator it = a.constBegin(); it != a.constEnd(); ++it) {
+    const AttrMap& a = n->meta->attrs();
+    for( AttrMap::ConstIterator it = a.constBegin(); it != a.constEnd(); ++it) {
         const QString& key = it.key();
+        const quint16 atom = it.atom();
 
-        if( key == "width") {
+        if( atom == Atom::A_width) {
             error(n->pos.row, "unsupported table attribute 'width'; "
                   "table width is determined by the rendering backend");
-        } else if( key == "cols") {
+        } else if( atom == Atom::A_cols) {
             if( !isValidColSpec(it.value()))
                 error(n->pos.row, "invalid 'cols' format '" + it.value() +
                       "'; expected relative widths (e.g. \"1,2,3\") "
                       "or alignment (e.g. \"<,^,>\")");
-        } else if( key == "options") {
+        } else if( atom == Atom::A_options) {
             const QString v = it.value().trimmed();
             QString inner = v;
             if( inner.startsWith('"') && inner.endsWith('"'))
@@ -224,9 +380,9 @@ void Validator::checkTableAttrs(const Node* n)
                 if( !opt.isEmpty() && !isKnownTableOption(opt))
                     error(n->pos.row, "unknown table option '" + opt + "'");
             }
-        } else if( key.startsWith("positional")) {
+        } else if( it.isPositional()) {
             // positional args: first is typically a block role; ignore for tables
-        } else if( key == "id" || key == "role") {
+        } else if( atom == Atom::A_id || atom == Atom::A_role) {
             // valid general attributes
         } else {
             error(n->pos.row, "unknown table attribute '" + key + "'");
@@ -236,11 +392,11 @@ void Validator::checkTableAttrs(const Node* n)
 
 void Validator::checkTableCellCount(const Node* n)
 {
-    if( !n->meta || !n->meta->attrs.contains("cols"))
+    if( !n->meta || !n->meta->attrs().contains(Atom::A_cols))
         return;
 
     // cross-check cols count vs actual table cell count
-    const int specCols = parseColsCount(n->meta->attrs.value("cols"));
+    const int specCols = parseColsCount(n->meta->attrs().value(Atom::A_cols));
     if( specCols <= 0)
         return;
 
@@ -262,29 +418,43 @@ void Validator::checkBlockAttrs(const Node* n)
     if( !n->meta )
         return;
 
-    const QMap<QString, QString>& a = n->meta->attrs;
-    for( QMap<QString, QString>::ConstIterator it = a.constBegin(); it != a.constEnd(); ++it) {
+    const AttrMap& a = n->meta->attrs();
+    for( AttrMap::ConstIterator it = a.constBegin(); it != a.constEnd(); ++it) {
         const QString& key = it.key();
+        const quint16 atom = it.atom();
 
-        if( key.startsWith("positional") )
+        if( it.isPositional() )
             continue;
 
         // known valid general attributes
-        if( key == "id" || key == "role" || key == "options")
+        if( atom == Atom::A_id || atom == Atom::A_role || atom == Atom::A_options)
             continue;
 
         // known valid named attributes for delimited/code blocks
         if( n->kind == Node::K_DelimitedBlock &&
-            (key == "source" || key == "language" || key == "linenums"))
+            (atom == Atom::A_source || atom == Atom::A_language || atom == Atom::A_linenums))
             continue;
 
-        if( key == "cols") {
+        // only attribute substitution in the raw bodies of listing and literal blocks
+        if( atom == Atom::A_subs && (n->kind == Node::K_LiteralParagraph ||
+                                     (n->kind == Node::K_DelimitedBlock &&
+                                      (n->delimKind == Node::DK_Listing || n->delimKind == Node::DK_Literal))) ) {
+            QString v = it.value();
+            if( v.startsWith('"') && v.endsWith('"'))
+                v = v.mid(1, v.size()-2);
+            if( v != "attributes" && v != "+attributes" )
+                warn(n->pos.row, "unsupported substitutions '" + v +
+                     "', only subs=\"attributes\" is supported");
+            continue;
+        }
+
+        if( atom == Atom::A_cols) {
             error(n->pos.row, "'cols' attribute is only valid on table blocks");
             continue;
         }
 
         // presentation-only attributes not supported in LeanDoc
-        if( key == "width" || key == "height") {
+        if( atom == Atom::A_width || atom == Atom::A_height) {
             error(n->pos.row, "unsupported presentation attribute '" + key + "'");
             continue;
         }
@@ -300,14 +470,14 @@ void Validator::checkSourceAttrContext(const Node* n)
         return;
 
     // [source,lang] should only appear before listing (----) or open (--) blocks
-    const QMap<QString, QString>& a = n->meta->attrs;
+    const AttrMap& a = n->meta->attrs();
     bool hasSource = false;
-    for( QMap<QString, QString>::ConstIterator it = a.constBegin(); it != a.constEnd(); ++it) {
-        if( it.key().startsWith("positional") && it.value() == "source") {
+    for( AttrMap::ConstIterator it = a.constBegin(); it != a.constEnd(); ++it) {
+        if( it.isPositional() && it.value() == "source") {
             hasSource = true;
             break;
         }
-        if( it.key() == "source") {
+        if( it.atom() == Atom::A_source) {
             hasSource = true;
             break;
         }
@@ -330,12 +500,12 @@ void Validator::checkAdmonitionAttrContext(const Node* n)
         return;
 
     // admonition-type attributes ([NOTE], [TIP], etc.) before non-delimited blocks
-    const QMap<QString, QString>& a = n->meta->attrs;
+    const AttrMap& a = n->meta->attrs();
     static const char* admonTypes[] = {"NOTE", "TIP", "WARNING", "CAUTION", "IMPORTANT"};
     const int nadmon = 5;
 
-    for( QMap<QString, QString>::ConstIterator it = a.constBegin(); it != a.constEnd(); ++it) {
-        if( !it.key().startsWith("positional"))
+    for( AttrMap::ConstIterator it = a.constBegin(); it != a.constEnd(); ++it) {
+        if( !it.isPositional())
             continue;
         const QString v = it.value();
         for( int i = 0; i < nadmon; ++i) {
@@ -357,9 +527,9 @@ void Validator::checkRoleContext(const Node* n)
         return;
 
     // validate roles for correct context
-    const QMap<QString, QString>& a = n->meta->attrs;
-    for( QMap<QString, QString>::ConstIterator it = a.constBegin(); it != a.constEnd(); ++it) {
-        if( it.key() == "role" || (it.key().startsWith("positional") && it.value().startsWith('.'))) {
+    const AttrMap& a = n->meta->attrs();
+    for( AttrMap::ConstIterator it = a.constBegin(); it != a.constEnd(); ++it) {
+        if( it.atom() == Atom::A_role || (it.isPositional() && it.value().startsWith('.'))) {
             QString role = it.value();
             if( role.startsWith('.'))
                 role = role.mid(1);
@@ -379,7 +549,7 @@ void Validator::checkColsOnNonTable(const Node* n)
     if( !n->meta)
         return;
     // warn about cols attribute on non-table blocks
-    if( n->meta->attrs.contains("cols"))
+    if( n->meta->attrs().contains(Atom::A_cols))
         error(n->pos.row, "'cols' attribute is only valid on table blocks");
 }
 
@@ -387,12 +557,25 @@ void Validator::checkXref(const Node* n)
 {
     if( n->target.isEmpty()) return;
 
-    // block IDs are case-sensitive and must be explicitly declared
+    // block IDs are case-sensitive and must be explicitly declared, or be a section title
     const QString id = n->target.trimmed();
-    if( !danchors.contains(id) )
+    if( resolves(id) )
+        return;
+    if( dstreaming ) {
+        // the anchor may still follow
+        PendingXref x;
+        x.line = n->pos.row;
+        x.id = id;
+        dpendingXrefs.append(x);
+    } else
         warn(n->pos.row, "unresolved cross-reference '<<" + id + ">>'");
 }
 
+bool Validator::resolves(const QString& id) const
+{
+    return danchors.contains(id) || (dtitles && !dtitles->resolve(id).isEmpty());
+}
+
 void Validator::warn(int line, const QString& msg)
 {
     diagnostics.append(Diagnostic(Diagnostic::Warning, line, msg));
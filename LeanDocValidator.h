@@ -24,30 +24,40 @@
 #include <QtCore/QList>
 #include <QtCore/QSet>
 #include "LeanDocAst2.h"
+#include "LeanDocDiagnostics.h"
 
 namespace LeanDoc {
 
-struct Diagnostic {
-    enum Level { Warning, Error };
-    Level level;
-    int line;
-    QString message;
-    Diagnostic():level(Warning),line(0){}
-    Diagnostic(Level lv, int l, const QString& m):level(lv),line(l),message(m){}
-};
+class TitleIndex;
 
 class Validator {
 public:
+    Validator():dsink(0),dtitles(0),dstreaming(false){}
+    // the diagnostics are also reported to the sink, as soon as each top-level block is checked
+    void setSink(DiagnosticSink* s) { dsink = s; }
+    // cross-references may also name a section title; when streaming the index must already
+    // include the block passed to validateBlock
+    void setTitles(const TitleIndex* t) { dtitles = t; }
     void validate(const Node* doc);
     QList<Diagnostic> diagnostics;
 
+    // streaming: the blocks are checked one by one and can be freed afterwards; only the
+    // anchor IDs are kept, and cross-references to anchors not seen yet are decided by end().
+    // Each call replaces the diagnostics with its own.
+    void begin(const Node* doc); // the document header
+    void validateBlock(const Node* block);
+    void end();
+
 private:
+    friend class CheckBlockTask;
     void collectAnchors(const Node* n);
+    void checkStreamedLabel(int line, const QString& id);
     void checkNode(const Node* n);
 
     void checkTableAttrs(const Node* n);
     void checkBlockAttrs(const Node* n);
     void checkXref(const Node* n);
+    bool resolves(const QString& id) const;
     void checkSourceAttrContext(const Node* n);
     void checkRoleContext(const Node* n);
     void checkColsOnNonTable(const Node* n);
@@ -56,9 +66,18 @@ private:
 
     void warn(int line, const QString& msg);
     void error(int line, const QString& msg);
+    void report(int first);
 
     QSet<QString> danchors; // declared anchor IDs
     QMap<QString, int> danchorLines; // anchor ID -> first occurrence line
+    DiagnosticSink* dsink;
+    const TitleIndex* dtitles;
+    struct PendingXref {
+        int line;
+        QString id;
+    };
+    QList<PendingXref> dpendingXrefs; // streaming, unresolved so far
+    bool dstreaming;
 };
 
 } // namespace LeanDoc
@@ -29,6 +29,7 @@
 #include "LeanDocPreprocessor.h"
 #include "LeanDocAst2.h"
 #include "LeanDocValidator.h"
+#include "LeanDocUtf8.h"
 
 using namespace LeanDoc;
 
@@ -45,7 +46,8 @@ static void dumpTokens(const QString& input, QTextStream& out)
     out << eof.lineNo << ": " << LineTok::kindName(eof.kind) << "\n";
 }
 
-static bool readFileUtf8(const QString& path, QString* outText, QString* outErr)
+static bool readFileUtf8(const QString& path, QString* outText, QString* outErr,
+                         QList<Utf8Decoder::Error>* decodeErrors)
 {
     QFile f(path);
     if (!f.open(QIODevice::ReadOnly)) {
@@ -53,7 +55,9 @@ static bool readFileUtf8(const QString& path, QString* outText, QString* outErr)
         return false;
     }
     QByteArray bytes = f.readAll();
-    *outText = QString::fromUtf8(bytes.constData(), bytes.size());
+    Utf8Decoder dec;
+    *outText = dec.decode(bytes);
+    if (decodeErrors) *decodeErrors = dec.errors;
     return true;
 }
 
@@ -91,10 +95,14 @@ int main(int argc, char** argv)
     }
 
     QString text, ioErr;
-    if (!readFileUtf8(filePath, &text, &ioErr)) {
+    QList<Utf8Decoder::Error> decodeErrors;
+    if (!readFileUtf8(filePath, &text, &ioErr, &decodeErrors)) {
         err << ioErr << "\n";
         return 2;
     }
+    for (int i = 0; i < decodeErrors.size(); ++i)
+        err << "Error at line " << decodeErrors[i].pos.row << ", column " << decodeErrors[i].pos.col
+            << ": " << decodeErrors[i].message << "\n";
 
     if (modeTokens) {
         dumpTokens(text, out);
@@ -131,7 +139,7 @@ int main(int argc, char** argv)
     doc->dump(out);
     Node::deleteTree(doc);
 
-    bool hasErrors = !p.errors.isEmpty();
+    bool hasErrors = !p.errors.isEmpty() || !decodeErrors.isEmpty();
     for (int i = 0; i < v.diagnostics.size(); ++i) {
         if (v.diagnostics[i].level == Diagnostic::Error)
             hasErrors = true;
@@ -10,15 +10,33 @@ TEMPLATE = app
 
 HEADERS += \
     LeanDocAst2.h \
+    LeanDocAtoms.h \
+    LeanDocMacros.h \
+    LeanDocSnapshot.h \
     LeanDocLexer2.h \
     LeanDocParser2.h \
+    LeanDocReplacements.h \
     LeanDocPreprocessor.h \
-    LeanDocValidator.h
+    LeanDocIndex.h \
+    LeanDocValidator.h \
+    LeanDocUtf8.h \
+    LeanDocDiagnostics.h \
+    LeanDocScheduler.h \
+    LeanDocJobServer.h
 
 SOURCES += \
     LeanDocAst2.cpp \
+    LeanDocAtoms.cpp \
+    LeanDocMacros.cpp \
+    LeanDocSnapshot.cpp \
     LeanDocLexer2.cpp \
     LeanDocParser2.cpp \
+    LeanDocReplacements.cpp \
     LeanDocPreprocessor.cpp \
+    LeanDocIndex.cpp \
     LeanDocValidator.cpp \
+    LeanDocUtf8.cpp \
+    LeanDocDiagnostics.cpp \
+    LeanDocScheduler.cpp \
+    LeanDocJobServer.cpp \
     dumper.cpp
@@ -10,20 +10,50 @@ TEMPLATE = app
 
 HEADERS += \
     LeanDocAst2.h \
+    LeanDocAtoms.h \
+    LeanDocMacros.h \
+    LeanDocSnapshot.h \
+    LeanDocIr.h \
     LeanDocLexer2.h \
     LeanDocParser2.h \
+    LeanDocReplacements.h \
     LeanDocPreprocessor.h \
     LeanDocTypstGen.h \
-    LeanDocValidator.h
+    LeanDocIndex.h \
+    LeanDocMath.h \
+    LeanDocAssets.h \
+    LeanDocValidator.h \
+    LeanDocNormalizer.h \
+    LeanDocUtf8.h \
+    LeanDocDiagnostics.h \
+    LeanDocScheduler.h \
+    LeanDocJobServer.h \
+    LeanDocPipeline.h \
+    LeanDocFileIo.h
 
 SOURCES += \
     LeanDoc2Typst.cpp \
     LeanDocAst2.cpp \
+    LeanDocAtoms.cpp \
+    LeanDocMacros.cpp \
+    LeanDocSnapshot.cpp \
+    LeanDocIr.cpp \
     LeanDocLexer2.cpp \
     LeanDocParser2.cpp \
+    LeanDocReplacements.cpp \
     LeanDocPreprocessor.cpp \
     LeanDocTypstGen.cpp \
-    LeanDocValidator.cpp
+    LeanDocIndex.cpp \
+    LeanDocMath.cpp \
+    LeanDocAssets.cpp \
+    LeanDocValidator.cpp \
+    LeanDocNormalizer.cpp \
+    LeanDocUtf8.cpp \
+    LeanDocDiagnostics.cpp \
+    LeanDocScheduler.cpp \
+    LeanDocJobServer.cpp \
+    LeanDocPipeline.cpp \
+    LeanDocFileIo.cpp
 
 
 